@@ -8,7 +8,25 @@ CONFIG -= app_bundle
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
-        main.cpp
+        decoder.cpp \
+        lzw.cpp \
+        lzwencoder.cpp \
+        main.cpp \
+        mappedfile.cpp \
+        predictor.cpp \
+        threadpool.cpp \
+        tiff.cpp \
+        tiffwriter.cpp
+
+HEADERS += \
+        decoder.h \
+        lzw.h \
+        lzwencoder.h \
+        mappedfile.h \
+        predictor.h \
+        threadpool.h \
+        tiff.h \
+        tiffwriter.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,743 @@
+/*
+    Decoder benchmark.  Every decode variant is run over a corpus of tiffs and, per image
+    and variant, the min, median and 99th percentile of single decodes are reported with
+    MB/s and MP/s of decoded image worked out from the geometry in the IFD.
+
+        bench [--json results.json] [--time ms] [--counters] [--no-synthetic]
+              [--rows-per-strip] [file.tif ...]
+
+    The corpus is the synthetic set of corpus.h plus the tiffs named on the command line,
+    or lzw.tif in the working directory when none are.  Each measurement starts with a
+    few warmup decodes (page faults, code tables, predictor dispatch) and then times
+    single decodes with steady_clock until both a minimum count and the time budget are
+    reached.  The output of every variant is checked, against the known pixels of a
+    synthetic image or against the first variant for a file; the exit code is 1 when a
+    check fails so a script can use the run as a regression test.  The encode row is
+    compressLZW on every strip of the decoded image, in MB/s of uncompressed input so it
+    lines up with the decodes; its check is a decode of the new strips.  write and
+    writeParallel time writeTiff and writeTiffParallel of the whole file into memory.
+    rows is decodeImageRows into a byte histogram, the row at a time path with no image
+    buffer.  interleave decodes a planar image to chunky pixels.
+
+    --rows-per-strip rewrites each image with writeTiffParallel at RowsPerStrip 8, 32,
+    128, 512, the whole image and the writer's own choice (chooseRowsPerStrip), and times
+    decodeImageParallel of each file.  A row is named for the RowsPerStrip written; a
+    value that clamps to the image height of one already run is skipped.
+
+    --counters adds a hardware counter profile of each image (counters.h), split by
+    phase: the bit reader alone (countLzwCodes), LZW with no predictor for each engine,
+    which is the bit reader plus table update and output, the predictor stage alone and
+    the whole decode.  Table update and output are shown as the copy table less the bit
+    reader; inside one loop they share every code and cannot be counted apart.  Counts
+    are per decoded byte and per code.
+*/
+
+#include "corpus.h"
+#include "counters.h"
+
+#include "decoder.h"
+#include "lzwencoder.h"
+#include "mappedfile.h"
+#include "predictor.h"
+#include "tiff.h"
+#include "tiffwriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Settings
+{
+    double timeMs = 500;                        // time budget of one measurement
+    int warmupRuns = 3;
+    int minRuns = 10;
+    bool counters = false;                      // hardware counter profile as well
+    bool stripSweep = false;                    // decode rewritten with each RowsPerStrip
+};
+
+// single decode times of one measurement, ms
+struct Timing
+{
+    size_t runs = 0;
+    double min = 0;
+    double median = 0;
+    double p99 = 0;
+};
+
+Timing measure(const Settings &settings, const std::function<void()> &run)
+{
+    typedef std::chrono::steady_clock Clock;
+    for (int i = 0; i != settings.warmupRuns; ++i) run();
+
+    std::vector<double> ms;
+    const Clock::time_point begin = Clock::now();
+    double elapsed = 0;
+    while ((int)ms.size() < settings.minRuns || elapsed < settings.timeMs) {
+        const Clock::time_point start = Clock::now();
+        run();
+        const Clock::time_point end = Clock::now();
+        ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        elapsed = std::chrono::duration<double, std::milli>(end - begin).count();
+    }
+
+    std::sort(ms.begin(), ms.end());
+    Timing t;
+    t.runs = ms.size();
+    t.min = ms.front();
+    t.median = ms[ms.size() / 2];
+    t.p99 = ms[(size_t)std::ceil(ms.size() * 0.99) - 1];
+    return t;
+}
+
+// hardware counts of one phase, per run, -1 when not available
+struct Phase
+{
+    std::string name;
+    size_t runs = 0;
+    double counts[COUNTER_COUNT];
+};
+
+Phase profile(const Settings &settings, PerfCounters &counters, const std::string &name,
+              const std::function<void()> &run)
+{
+    typedef std::chrono::steady_clock Clock;
+    for (int i = 0; i != settings.warmupRuns; ++i) run();
+
+    Phase phase;
+    phase.name = name;
+    const Clock::time_point begin = Clock::now();
+    counters.start();
+    do {
+        run();
+        ++phase.runs;
+    } while ((int)phase.runs < settings.minRuns ||
+             std::chrono::duration<double, std::milli>(Clock::now() - begin).count() <
+                 settings.timeMs);
+    counters.stop();
+    for (int c = 0; c != COUNTER_COUNT; ++c) {
+        const double v = counters.value((Counter)c);
+        phase.counts[c] = v < 0 ? -1 : v / phase.runs;
+    }
+    return phase;
+}
+
+// one tiff of the corpus, held in memory or mapped
+struct Image
+{
+    std::string name;
+    const char* file = nullptr;
+    size_t fileSize = 0;
+    const std::vector<char>* expected = nullptr;    // known decode, synthetic only
+    TiffInfo info;
+    std::vector<uint32_t> stripOffsets;
+    std::vector<uint32_t> stripByteCounts;
+    size_t compressedBytes = 0;
+};
+
+struct Result
+{
+    std::string variant;
+    Timing timing;
+    double bytes;                               // decoded by one run
+    double pixels;
+    bool ok;
+};
+
+// everything measured on one image
+struct ImageResults
+{
+    std::vector<Result> results;
+    std::vector<Phase> phases;                  // --counters only
+    LzwStats stats;                             // all strips
+};
+
+bool openImage(Image &image)
+{
+    TiffInfo &info = image.info;
+    if (!parseTiff(image.file, image.fileSize, info) || info.compression != COMPRESSION_LZW)
+        return false;
+    image.stripOffsets.resize(info.stripCount);
+    image.stripByteCounts.resize(info.stripCount);
+    if (!readStripTable(image.file, image.fileSize, info, image.stripOffsets.data(),
+                        image.stripByteCounts.data()))
+        return false;
+    for (uint32_t count : image.stripByteCounts) image.compressedBytes += count;
+    return true;
+}
+
+// the predictor stage on every row of an image (any bytes, only the time matters)
+void undoPredictor(const TiffInfo &info, std::vector<char> &rows)
+{
+    const int stride = lzwParams(info).stride;
+    const uint32_t bytesPerRow = info.bytesPerRow();
+    const int sampleBytes = info.bitsPerSample / 8;
+    for (size_t r = 0; r + bytesPerRow <= rows.size(); r += bytesPerRow) {
+        if (info.predictor == PREDICTOR_FLOATINGPOINT)
+            undoFloatingPointPredictor(&rows[r], bytesPerRow, stride / sampleBytes, sampleBytes);
+        else if (info.bitsPerSample == 16)
+            undoHorizontalPredictor16(&rows[r], bytesPerRow, stride / 2,
+                                      info.bigEndian != hostBigEndian());
+        else
+            undoHorizontalPredictor8(&rows[r], bytesPerRow, stride);
+    }
+}
+
+std::vector<Result> benchImage(const Image &image, const Settings &settings, ThreadPool &pool)
+{
+    const TiffInfo &info = image.info;
+    const size_t imageBytes = info.imageBytes();
+    const double pixels = (double)info.width * info.height;
+    std::vector<char> out(imageBytes);
+    std::vector<char> first;                    // reference decode of a file
+    std::vector<Result> results;
+
+    auto check = [&]() {
+        if (image.expected) return out == *image.expected;
+        if (first.empty()) first = out;
+        return out == first;
+    };
+
+    // whole image, each code table layout, predictor stage and the pool
+    struct Variant
+    {
+        const char* name;
+        LzwEngine engine;
+        LzwPredictorMode predictorMode;
+        bool checked;
+        bool parallel;
+    };
+    const Variant variants[] = {
+        {"copyFused", LZW_COPY_TABLE, LZW_PREDICT_FUSED, false, false},
+        {"copyRows", LZW_COPY_TABLE, LZW_PREDICT_ROWS, false, false},
+        {"chainFused", LZW_PREFIX_CHAIN, LZW_PREDICT_FUSED, false, false},
+        {"chainRows", LZW_PREFIX_CHAIN, LZW_PREDICT_ROWS, false, false},
+        {"copyChecked", LZW_COPY_TABLE, LZW_PREDICT_FUSED, true, false},
+        {"parallel", LZW_COPY_TABLE, LZW_PREDICT_FUSED, false, true},
+    };
+    for (const Variant &v : variants) {
+        if (info.predictor == PREDICTOR_NONE && v.predictorMode == LZW_PREDICT_ROWS)
+            continue;
+        DecodeOptions options;
+        options.engine = v.engine;
+        options.predictorMode = v.predictorMode;
+        options.checked = v.checked;
+        std::fill(out.begin(), out.end(), 0);
+        bool ok = true;
+        const Timing t = measure(settings, [&] {
+            if (v.parallel)
+                ok &= decodeImageParallel(image.file, image.fileSize, info,
+                                          image.stripOffsets.data(),
+                                          image.stripByteCounts.data(), out.data(), pool,
+                                          options);
+            else
+                ok &= decodeImage(image.file, image.fileSize, info, image.stripOffsets.data(),
+                                  image.stripByteCounts.data(), out.data(), options);
+        });
+        ok = check() && ok;
+        results.push_back({v.name, t, (double)imageBytes, pixels, ok});
+    }
+    const std::vector<char> &reference = image.expected ? *image.expected : first;
+
+    // a planar image decoded to chunky pixels, checked against its planes interleaved here
+    if (info.planes() > 1 && info.bitsPerSample % 8 == 0) {
+        const size_t sampleBytes = info.bitsPerSample / 8;
+        const size_t planeBytes = imageBytes / info.planes();
+        std::vector<char> chunky(imageBytes);
+        for (size_t i = 0; i != planeBytes / sampleBytes; ++i) {
+            for (uint32_t p = 0; p != info.planes(); ++p) {
+                std::memcpy(&chunky[(i * info.planes() + p) * sampleBytes],
+                            &reference[p * planeBytes + i * sampleBytes], sampleBytes);
+            }
+        }
+        DecodeOptions options;
+        options.interleave = true;
+        bool ok = true;
+        const Timing t = measure(settings, [&] {
+            ok &= decodeImageParallel(image.file, image.fileSize, info,
+                                      image.stripOffsets.data(), image.stripByteCounts.data(),
+                                      out.data(), pool, options);
+        });
+        ok = out == chunky && ok;
+        results.push_back({"interleave", t, (double)imageBytes, pixels, ok});
+    }
+
+    // a centred window a quarter of the image, checked against the whole decode
+    if (info.bitsPerSample % 8 == 0) {
+        ImageRegion region;
+        region.width = std::max(info.width / 2, 1u);
+        region.height = std::max(info.height / 2, 1u);
+        region.x = info.width / 4;
+        region.y = info.height / 4;
+        const size_t pixelBytes = info.bytesPerRow() / info.width;
+        const size_t rowBytes = region.width * pixelBytes;
+        std::vector<char> window(rowBytes * region.height * info.planes());
+        bool ok = true;
+        const Timing t = measure(settings, [&] {
+            ok &= decodeRegionParallel(image.file, image.fileSize, info,
+                                       image.stripOffsets.data(), image.stripByteCounts.data(),
+                                       region, window.data(), pool);
+        });
+        for (uint32_t p = 0; p != info.planes(); ++p) {
+            for (uint32_t y = 0; y != region.height; ++y) {
+                const size_t src = ((size_t)p * info.height + region.y + y) * info.bytesPerRow() +
+                                   region.x * pixelBytes;
+                ok &= !std::memcmp(&window[((size_t)p * region.height + y) * rowBytes],
+                                   &reference[src], rowBytes);
+            }
+        }
+        results.push_back({"region", t, (double)window.size(),
+                           (double)region.width * region.height, ok});
+    }
+
+    // rows pushed to a sink one at a time, no image buffer; timed with a byte histogram
+    // as the consumer, checked by copying the rows into place
+    if (!info.tiled) {
+        const size_t rowBytes = info.bytesPerRow();
+        std::vector<size_t> histogram(256);
+        bool ok = true;
+        const Timing t = measure(settings, [&] {
+            ok &= decodeImageRows(image.file, image.fileSize, info, image.stripOffsets.data(),
+                                  image.stripByteCounts.data(),
+                                  [&](const char* row, uint32_t, uint32_t) {
+                for (size_t i = 0; i != rowBytes; ++i) ++histogram[(uint8_t)row[i]];
+                return true;
+            });
+        });
+        std::fill(out.begin(), out.end(), 0);
+        ok &= decodeImageRows(image.file, image.fileSize, info, image.stripOffsets.data(),
+                              image.stripByteCounts.data(),
+                              [&](const char* row, uint32_t y, uint32_t plane) {
+            std::memcpy(&out[((size_t)plane * info.height + y) * rowBytes], row, rowBytes);
+            return true;
+        });
+        ok = out == reference && ok;
+        results.push_back({"rows", t, (double)imageBytes, pixels, ok});
+    }
+
+    // predictor stage alone over the decoded image, per kernel set
+    if (info.predictor != PREDICTOR_NONE) {
+        const PredictorIsa best = predictorIsa();
+        std::vector<char> rows(reference);
+        for (int isa = PREDICTOR_SCALAR; isa <= best; ++isa) {
+            if (!setPredictorIsa((PredictorIsa)isa)) continue;
+            const Timing t = measure(settings, [&] { undoPredictor(info, rows); });
+            results.push_back({std::string("undo ") + predictorIsaName((PredictorIsa)isa), t,
+                               (double)imageBytes, pixels, true});
+        }
+        setPredictorIsa(best);
+    }
+
+    // the encoder on every strip of the decoded image, checked by decoding it back
+    const bool encodable = info.predictor == PREDICTOR_NONE ||
+                           (info.predictor == PREDICTOR_HORIZONTAL &&
+                            (info.bitsPerSample == 8 || info.bitsPerSample == 16));
+    if (!info.tiled && encodable) {
+        const LzwParams p = lzwParams(info);
+        const size_t stripBytes = (size_t)info.rowsPerStrip * info.bytesPerRow();
+        std::vector<std::vector<char>> strips(info.stripCount,
+                                              std::vector<char>(lzwCompressBound(stripBytes)));
+        std::vector<size_t> lengths(info.stripCount);
+        const Timing t = measure(settings, [&] {
+            size_t pos = 0;
+            for (uint32_t s = 0; s != info.stripCount; ++s) {
+                const size_t n = (size_t)info.rowsInStrip(s) * info.bytesPerRow();
+                lengths[s] = compressLZW(&reference[pos], n, strips[s].data(), strips[s].size(), p);
+                pos += n;
+            }
+        });
+        std::vector<char> back(stripBytes);
+        bool ok = true;
+        size_t pos = 0;
+        for (uint32_t s = 0; s != info.stripCount; ++s) {
+            const size_t n = (size_t)info.rowsInStrip(s) * info.bytesPerRow();
+            const LzwResult r = decompressLZW(strips[s].data(), lengths[s], back.data(), n, p);
+            ok &= lengths[s] && r.status == LZW_OK && r.bytesWritten == n &&
+                  !std::memcmp(back.data(), &reference[pos], n);
+            pos += n;
+        }
+        results.push_back({"encode", t, (double)imageBytes, pixels, ok});
+
+        // the whole file into memory, one thread and the pool, checked by decoding it
+        for (int parallel = 0; parallel != 2; ++parallel) {
+            std::string file;
+            bool written = true;
+            const Timing t = measure(settings, [&] {
+                std::ostringstream f;
+                written &= parallel ? writeTiffParallel(f, info, reference.data(), pool)
+                                    : writeTiff(f, info, reference.data());
+                file = f.str();
+            });
+            TiffInfo back;
+            bool ok = written && parseTiff(file.data(), file.size(), back);
+            if (ok) {
+                std::vector<uint32_t> offsets(back.stripCount), counts(back.stripCount);
+                std::fill(out.begin(), out.end(), 0);
+                ok = readStripTable(file.data(), file.size(), back, offsets.data(),
+                                    counts.data()) &&
+                     decodeImage(file.data(), file.size(), back, offsets.data(), counts.data(),
+                                 out.data()) &&
+                     out == reference;
+            }
+            results.push_back({parallel ? "writeParallel" : "write", t, (double)imageBytes,
+                               pixels, ok});
+        }
+
+        // --rows-per-strip: the image written again with each RowsPerStrip, 0 is the
+        // writer's choice for the pool, and decoded on the pool; a value that clamps to
+        // the height of one already measured is skipped
+        const uint32_t sweep[] = {8, 32, 128, 512, 0xFFFFFFFF, 0};
+        std::vector<uint32_t> measured;
+        for (size_t i = 0; settings.stripSweep && i != sizeof(sweep) / sizeof(sweep[0]); ++i) {
+            const uint32_t rows = std::min(sweep[i], info.height);
+            if (sweep[i] && std::count(measured.begin(), measured.end(), rows)) continue;
+            measured.push_back(rows);
+            TiffInfo written = info;
+            written.rowsPerStrip = sweep[i];
+            std::ostringstream f;
+            bool ok = writeTiffParallel(f, written, reference.data(), pool);
+            const std::string file = f.str();
+            TiffInfo back;
+            ok = ok && parseTiff(file.data(), file.size(), back);
+            std::vector<uint32_t> offsets(back.stripCount), counts(back.stripCount);
+            ok = ok && readStripTable(file.data(), file.size(), back, offsets.data(),
+                                      counts.data());
+            std::fill(out.begin(), out.end(), 0);
+            const Timing t = measure(settings, [&] {
+                ok = ok && decodeImageParallel(file.data(), file.size(), back, offsets.data(),
+                                               counts.data(), out.data(), pool);
+            });
+            ok = ok && out == reference;
+            std::ostringstream name;
+            name << (sweep[i] ? "rows " : "rows auto ") << back.rowsPerStrip;
+            results.push_back({name.str(), t, (double)imageBytes, pixels, ok});
+        }
+    }
+    return results;
+}
+
+std::vector<Phase> profileImage(const Image &image, const Settings &settings,
+                                PerfCounters &counters)
+{
+    const TiffInfo &info = image.info;
+    const uint32_t* offsets = image.stripOffsets.data();
+    const uint32_t* counts = image.stripByteCounts.data();
+    std::vector<Phase> phases;
+
+    volatile size_t codes = 0;                  // keeps the bits phase from being dropped
+    phases.push_back(profile(settings, counters, "bits", [&] {
+        size_t n = 0;
+        for (uint32_t s = 0; s != info.stripCount; ++s)
+            n += countLzwCodes(image.file + offsets[s], counts[s]);
+        codes = n;
+    }));
+
+    // LZW only: no predictor and no byte swap, into one strip's worth of scratch
+    LzwParams p = lzwParams(info);
+    p.predictor = false;
+    p.floatingPoint = false;
+    p.bigEndian = hostBigEndian();
+    std::vector<char> chunk((size_t)p.bytesPerRow * (info.tiled ? info.tileLength
+                                                                : info.rowsPerStrip));
+    const LzwEngine engines[] = {LZW_COPY_TABLE, LZW_PREFIX_CHAIN};
+    for (LzwEngine engine : engines) {
+        p.engine = engine;
+        phases.push_back(profile(settings, counters,
+                                 engine == LZW_COPY_TABLE ? "lzw copy" : "lzw chain", [&] {
+            for (uint32_t s = 0; s != info.stripCount; ++s)
+                decompressLZW(image.file + offsets[s], counts[s], chunk.data(), chunk.size(), p);
+        }));
+    }
+
+    // table update and output of the copy table, as the difference
+    Phase table;
+    table.name = "table+output";
+    table.runs = phases[1].runs;
+    for (int c = 0; c != COUNTER_COUNT; ++c) {
+        const double bits = phases[0].counts[c];
+        const double lzw = phases[1].counts[c];
+        table.counts[c] = bits < 0 || lzw < 0 ? -1 : std::max(lzw - bits, 0.0);
+    }
+    phases.push_back(table);
+
+    std::vector<char> out(info.imageBytes());
+    if (info.predictor != PREDICTOR_NONE)
+        phases.push_back(profile(settings, counters, "predictor", [&] { undoPredictor(info, out); }));
+    phases.push_back(profile(settings, counters, "decode", [&] {
+        decodeImage(image.file, image.fileSize, info, offsets, counts, out.data());
+    }));
+    return phases;
+}
+
+void printResults(const Image &image, const std::vector<Result> &results)
+{
+    const TiffInfo &info = image.info;
+    std::cout << image.name << "   " << info.width << " x " << info.height << " x "
+              << info.samplesPerPixel << " x " << info.bitsPerSample
+              << "   predictor: " << info.predictor
+              << (info.tiled ? "   tiles: " : "   strips: ") << info.stripCount
+              << std::fixed << std::setprecision(2)
+              << "   ratio: " << (double)info.imageBytes() / image.compressedBytes << '\n';
+    std::cout << std::left << std::setw(16) << "  variant" << std::right
+              << std::setw(8) << "runs" << std::setw(10) << "min ms" << std::setw(10)
+              << "median" << std::setw(10) << "p99" << std::setw(10) << "MB/s"
+              << std::setw(10) << "MP/s" << '\n';
+    for (const Result &r : results) {
+        std::cout << "  " << std::left << std::setw(14) << r.variant << std::right
+                  << std::setw(8) << r.timing.runs
+                  << std::setprecision(3)
+                  << std::setw(10) << r.timing.min << std::setw(10) << r.timing.median
+                  << std::setw(10) << r.timing.p99
+                  << std::setprecision(1)
+                  << std::setw(10) << r.bytes / 1e3 / r.timing.median
+                  << std::setw(10) << r.pixels / 1e3 / r.timing.median
+                  << (r.ok ? "" : "   FAILED") << '\n';
+    }
+}
+
+// LZW statistics of the image, one decode of every strip
+LzwStats imageStats(const Image &image)
+{
+    const TiffInfo &info = image.info;
+    const LzwParams p = lzwParams(info);
+    std::vector<char> chunk((size_t)p.bytesPerRow * (info.tiled ? info.tileLength
+                                                                : info.rowsPerStrip));
+    LzwStats stats;
+    for (uint32_t s = 0; s != info.stripCount; ++s) {
+        decompressLZW(image.file + image.stripOffsets[s], image.stripByteCounts[s],
+                      chunk.data(), chunk.size(), p, LzwDecoderState::threadState(), stats);
+    }
+    return stats;
+}
+
+void printStats(const LzwStats &stats)
+{
+    std::cout << "  codes: " << stats.codes << "   clears: " << stats.clears
+              << "   table full: " << stats.tableFulls << "   kwkwk: " << stats.kwkwk
+              << std::setprecision(2) << "   mean string: " << stats.meanLength()
+              << "   lengths:";
+    for (size_t count : stats.lengths) std::cout << ' ' << count;
+    std::cout << '\n' << '\n';
+}
+
+// per decoded byte and per code, a dash where the counter is not available
+void printPhases(const Image &image, const ImageResults &r)
+{
+    const double bytes = (double)image.info.imageBytes();
+    auto count = [](double v, double per, int precision) {
+        std::ostringstream s;
+        if (v < 0) s << '-';
+        else s << std::fixed << std::setprecision(precision) << v / per;
+        return s.str();
+    };
+    std::cout << "  counters per byte                                                 per code" << '\n'
+              << std::left << std::setw(16) << "  phase" << std::right
+              << std::setw(9) << "cycles" << std::setw(9) << "instr" << std::setw(7) << "IPC"
+              << std::setw(10) << "br miss" << std::setw(10) << "L1D miss"
+              << std::setw(10) << "LLC miss" << std::setw(10) << "cycles"
+              << std::setw(10) << "br miss" << '\n';
+    for (const Phase &p : r.phases) {
+        const double* c = p.counts;
+        const double ipc = c[COUNTER_CYCLES] > 0 && c[COUNTER_INSTRUCTIONS] >= 0
+                         ? c[COUNTER_INSTRUCTIONS] / c[COUNTER_CYCLES] : -1;
+        std::cout << "  " << std::left << std::setw(14) << p.name << std::right
+                  << std::setw(9) << count(c[COUNTER_CYCLES], bytes, 2)
+                  << std::setw(9) << count(c[COUNTER_INSTRUCTIONS], bytes, 2)
+                  << std::setw(7) << count(ipc, 1, 2)
+                  << std::setw(10) << count(c[COUNTER_BRANCH_MISSES], bytes, 4)
+                  << std::setw(10) << count(c[COUNTER_L1D_MISSES], bytes, 4)
+                  << std::setw(10) << count(c[COUNTER_LLC_MISSES], bytes, 4)
+                  << std::setw(10) << count(c[COUNTER_CYCLES], (double)r.stats.codes, 1)
+                  << std::setw(10) << count(c[COUNTER_BRANCH_MISSES], (double)r.stats.codes, 3)
+                  << '\n';
+    }
+    std::cout << '\n';
+}
+
+std::string jsonString(const std::string &s)
+{
+    std::string j = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') j += '\\';
+        if ((unsigned char)c < 0x20) j += ' ';
+        else j += c;
+    }
+    return j + '"';
+}
+
+std::string jsonStats(const LzwStats &stats)
+{
+    std::ostringstream o;
+    o << "{\"codes\": " << stats.codes << ", \"clears\": " << stats.clears
+      << ", \"tableFulls\": " << stats.tableFulls << ", \"kwkwk\": " << stats.kwkwk
+      << ", \"meanLength\": " << stats.meanLength() << ", \"lengths\": [";
+    for (size_t i = 0; i != 12; ++i) o << (i ? ", " : "") << stats.lengths[i];
+    o << "]}";
+    return o.str();
+}
+
+void writeJson(std::ostream &o, const Settings &settings, int workers,
+               const std::deque<Image> &images, const std::vector<ImageResults> &results)
+{
+    o << std::setprecision(6) << std::defaultfloat;
+    o << "{\n"
+      << "  \"predictorIsa\": " << jsonString(predictorIsaName(predictorIsa())) << ",\n"
+      << "  \"workers\": " << workers << ",\n"
+      << "  \"warmupRuns\": " << settings.warmupRuns << ",\n"
+      << "  \"minRuns\": " << settings.minRuns << ",\n"
+      << "  \"timeMs\": " << settings.timeMs << ",\n"
+      << "  \"images\": [\n";
+    for (size_t i = 0; i != images.size(); ++i) {
+        const Image &image = images[i];
+        const TiffInfo &info = image.info;
+        o << "    {\n"
+          << "      \"name\": " << jsonString(image.name) << ",\n"
+          << "      \"synthetic\": " << (image.expected ? "true" : "false") << ",\n"
+          << "      \"width\": " << info.width << ",\n"
+          << "      \"height\": " << info.height << ",\n"
+          << "      \"samplesPerPixel\": " << info.samplesPerPixel << ",\n"
+          << "      \"bitsPerSample\": " << info.bitsPerSample << ",\n"
+          << "      \"predictor\": " << info.predictor << ",\n"
+          << "      \"planarConfiguration\": " << info.planarConfiguration << ",\n"
+          << "      \"tiled\": " << (info.tiled ? "true" : "false") << ",\n"
+          << "      \"strips\": " << info.stripCount << ",\n"
+          << "      \"compressedBytes\": " << image.compressedBytes << ",\n"
+          << "      \"decodedBytes\": " << info.imageBytes() << ",\n"
+          << "      \"stats\": " << jsonStats(results[i].stats) << ",\n";
+        if (settings.counters) {
+            // counts per run, null where not available
+            const std::vector<Phase> &phases = results[i].phases;
+            o << "      \"phases\": [\n";
+            for (size_t k = 0; k != phases.size(); ++k) {
+                o << "        {\"phase\": " << jsonString(phases[k].name)
+                  << ", \"runs\": " << phases[k].runs;
+                for (int c = 0; c != COUNTER_COUNT; ++c) {
+                    o << ", \"" << PerfCounters::name((Counter)c) << "\": ";
+                    if (phases[k].counts[c] < 0) o << "null";
+                    else o << phases[k].counts[c];
+                }
+                o << "}" << (k + 1 != phases.size() ? ",\n" : "\n");
+            }
+            o << "      ],\n";
+        }
+        o << "      \"results\": [\n";
+        const std::vector<Result> &rs = results[i].results;
+        for (size_t k = 0; k != rs.size(); ++k) {
+            const Result &r = rs[k];
+            o << "        {\"variant\": " << jsonString(r.variant)
+              << ", \"runs\": " << r.timing.runs
+              << ", \"minMs\": " << r.timing.min
+              << ", \"medianMs\": " << r.timing.median
+              << ", \"p99Ms\": " << r.timing.p99
+              << ", \"mbPerSec\": " << r.bytes / 1e3 / r.timing.median
+              << ", \"mpPerSec\": " << r.pixels / 1e3 / r.timing.median
+              << ", \"ok\": " << (r.ok ? "true" : "false") << "}"
+              << (k + 1 != rs.size() ? ",\n" : "\n");
+        }
+        o << "      ]\n    }" << (i + 1 != images.size() ? ",\n" : "\n");
+    }
+    o << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    std::string jsonPath;
+    bool synthetic = true;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else if (arg == "--time" && i + 1 < argc) settings.timeMs = std::atof(argv[++i]);
+        else if (arg == "--counters") settings.counters = true;
+        else if (arg == "--no-synthetic") synthetic = false;
+        else if (arg == "--rows-per-strip") settings.stripSweep = true;
+        else if (arg.compare(0, 2, "--") == 0) {
+            std::cout << "bench [--json results.json] [--time ms] [--counters] [--no-synthetic] "
+                         "[--rows-per-strip] [file.tif ...]" << '\n';
+            return 2;
+        }
+        else paths.push_back(arg);
+    }
+    if (paths.empty()) paths.push_back("lzw.tif");
+
+    // the corpus: synthetic images, then the files that open as LZW tiffs
+    std::vector<CorpusImage> corpus;
+    if (synthetic) corpus = syntheticCorpus();
+    std::deque<Image> images;
+    for (const CorpusImage &c : corpus) {
+        images.emplace_back();
+        Image &image = images.back();
+        image.name = c.name;
+        image.file = c.file.data();
+        image.fileSize = c.file.size();
+        image.expected = &c.pixels;
+        if (!openImage(image)) {
+            std::cout << c.name << ": bad synthetic image" << '\n';
+            return 1;
+        }
+    }
+    std::deque<MappedFile> files;
+    for (const std::string &path : paths) {
+        files.emplace_back();
+        if (!files.back().open(path)) {
+            std::cout << path << ": cannot open, skipped" << '\n';
+            continue;
+        }
+        images.emplace_back();
+        Image &image = images.back();
+        image.name = path;
+        image.file = files.back().data();
+        image.fileSize = files.back().size();
+        if (!openImage(image)) {
+            std::cout << path << " is not an LZW compressed tiff, skipped" << '\n';
+            images.pop_back();
+        }
+    }
+
+    ThreadPool pool;
+    std::cout << "predictor: " << predictorIsaName(predictorIsa())
+              << "   workers: " << pool.size() << '\n' << '\n';
+    PerfCounters counters;
+    if (settings.counters && !counters.available())
+        std::cout << "no hardware counters (not Linux, a VM or perf_event_paranoid)" << '\n' << '\n';
+
+    std::vector<ImageResults> results;
+    bool ok = true;
+    for (const Image &image : images) {
+        results.emplace_back();
+        ImageResults &r = results.back();
+        r.stats = imageStats(image);
+        r.results = benchImage(image, settings, pool);
+        printResults(image, r.results);
+        printStats(r.stats);
+        if (settings.counters) {
+            r.phases = profileImage(image, settings, counters);
+            printPhases(image, r);
+        }
+        for (const Result &result : r.results) ok &= result.ok;
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream json(jsonPath);
+        writeJson(json, settings, pool.size(), images, results);
+        if (!json) {
+            std::cout << "cannot write " << jsonPath << '\n';
+            return 1;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = bench
+
+# the decoder sources are built in from the main project
+INCLUDEPATH += ..
+
+SOURCES += \
+        ../decoder.cpp \
+        ../lzw.cpp \
+        ../lzwencoder.cpp \
+        ../mappedfile.cpp \
+        ../predictor.cpp \
+        ../threadpool.cpp \
+        ../tiff.cpp \
+        ../tiffwriter.cpp \
+        bench.cpp \
+        corpus.cpp \
+        counters.cpp
+
+HEADERS += \
+        ../decoder.h \
+        ../lzw.h \
+        ../lzwencoder.h \
+        ../mappedfile.h \
+        ../predictor.h \
+        ../threadpool.h \
+        ../tiff.h \
+        ../tiffwriter.h \
+        corpus.h \
+        counters.h
@@ -0,0 +1,300 @@
+#include "corpus.h"
+
+#include "decoder.h"
+#include "lzwencoder.h"
+#include "predictor.h"
+#include "tiffwriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+namespace {
+
+enum Content
+{
+    CONTENT_FLAT,                               // blocks of one colour
+    CONTENT_SMOOTH,                             // gradients with a little noise
+    CONTENT_NOISE                               // every sample random
+};
+
+enum Layout
+{
+    LAYOUT_CHUNKY,                              // strips of RGBRGB...
+    LAYOUT_PLANAR,                              // strips of one sample, PlanarConfiguration = 2
+    LAYOUT_TILED                                // chunky tiles, edge tiles padded
+};
+
+struct Spec
+{
+    const char* name;
+    uint16_t samplesPerPixel;
+    uint16_t bitsPerSample;
+    Content content;
+    bool predictor;                             // horizontal, floating point for 32 bit
+    bool bigEndian;
+    Layout layout;
+};
+
+const uint32_t width = 1024;
+const uint32_t height = 768;
+const uint32_t rowsPerStrip = 64;
+const uint32_t tileSize = 240;                  // edge tiles cut across and down
+
+const uint16_t TIFFTAG_SAMPLEFORMAT = 339;      // not read by parseTiff
+const uint16_t SAMPLEFORMAT_IEEEFP = 3;
+
+// values in the file's byte order
+void put16(std::vector<char> &f, uint32_t v, bool bigEndian)
+{
+    if (bigEndian) { f.push_back((char)(v >> 8)); f.push_back((char)v); }
+    else { f.push_back((char)v); f.push_back((char)(v >> 8)); }
+}
+
+void put32(std::vector<char> &f, uint32_t v, bool bigEndian)
+{
+    if (bigEndian) { put16(f, v >> 16, true); put16(f, v & 0xFFFF, true); }
+    else { put16(f, v & 0xFFFF, false); put16(f, v >> 16, false); }
+}
+
+// the floating point predictor on one row of host order samples: the row split into
+// byte planes, most significant first, then each byte less the one a pixel before it
+void floatingPointPredictor(char* row, size_t bytes, uint32_t stride, uint32_t sampleBytes)
+{
+    const size_t count = bytes / sampleBytes;
+    std::vector<char> planes(bytes);
+    for (size_t i = 0; i != count; ++i) {
+        for (uint32_t b = 0; b != sampleBytes; ++b)
+            planes[b * count + i] = row[i * sampleBytes +
+                                        (hostBigEndian() ? b : sampleBytes - 1 - b)];
+    }
+    for (size_t i = bytes; i-- > stride;) planes[i] = (char)(planes[i] - planes[i - stride]);
+    std::memcpy(row, planes.data(), bytes);
+}
+
+/*
+    A tiff writeTiff cannot write (tiles, the floating point predictor), put together
+    by hand: the header, the chunks coded with compressLZW and an IFD of LONG fields, in
+    tag order, with the arrays after it.  chunks are decoded chunks, rows of the chunk's
+    row length.  compressLZW has no floating point predictor, so it is applied here and
+    the rows are coded as plain bytes.
+*/
+std::vector<char> handBuiltTiff(const TiffInfo &info, std::vector<std::vector<char>> chunks)
+{
+    const bool be = info.bigEndian;
+    LzwParams p = lzwParams(info);
+    if (p.floatingPoint) {
+        const uint32_t sampleBytes = info.bitsPerSample / 8;
+        for (std::vector<char> &chunk : chunks) {
+            for (size_t r = 0; r + p.bytesPerRow <= chunk.size(); r += p.bytesPerRow)
+                floatingPointPredictor(&chunk[r], p.bytesPerRow, p.stride / sampleBytes,
+                                       sampleBytes);
+        }
+        p.floatingPoint = false;
+        p.bitsPerSample = 8;
+    }
+    std::vector<char> f;
+    f.push_back(be ? 'M' : 'I');
+    f.push_back(be ? 'M' : 'I');
+    put16(f, 42, be);
+    put32(f, 0, be);                            // IFD offset, set below
+
+    std::vector<uint32_t> offsets, counts;
+    std::vector<char> strip;
+    for (const std::vector<char> &chunk : chunks) {
+        compressLZW(chunk.data(), chunk.size(), strip, p);
+        offsets.push_back((uint32_t)f.size());
+        counts.push_back((uint32_t)strip.size());
+        f.insert(f.end(), strip.begin(), strip.end());
+    }
+    if (f.size() % 2) f.push_back(0);           // word aligned
+
+    const uint32_t spp = info.samplesPerPixel;
+    std::vector<std::pair<uint16_t, std::vector<uint32_t>>> fields = {
+        {TIFFTAG_IMAGEWIDTH, {info.width}},
+        {TIFFTAG_IMAGELENGTH, {info.height}},
+        {TIFFTAG_BITSPERSAMPLE, std::vector<uint32_t>(spp, info.bitsPerSample)},
+        {TIFFTAG_COMPRESSION, {COMPRESSION_LZW}},
+        {TIFFTAG_PHOTOMETRIC, {spp >= 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK}},
+        {TIFFTAG_SAMPLESPERPIXEL, {spp}},
+        {TIFFTAG_PLANARCONFIG, {info.planarConfiguration}},
+        {TIFFTAG_PREDICTOR, {info.predictor}},
+    };
+    if (info.predictor == PREDICTOR_FLOATINGPOINT)
+        fields.push_back({TIFFTAG_SAMPLEFORMAT, std::vector<uint32_t>(spp, SAMPLEFORMAT_IEEEFP)});
+    if (info.tiled) {
+        fields.push_back({TIFFTAG_TILEWIDTH, {info.tileWidth}});
+        fields.push_back({TIFFTAG_TILELENGTH, {info.tileLength}});
+        fields.push_back({TIFFTAG_TILEOFFSETS, offsets});
+        fields.push_back({TIFFTAG_TILEBYTECOUNTS, counts});
+    }
+    else {
+        fields.push_back({TIFFTAG_STRIPOFFSETS, offsets});
+        fields.push_back({TIFFTAG_ROWSPERSTRIP, {info.rowsPerStrip}});
+        fields.push_back({TIFFTAG_STRIPBYTECOUNTS, counts});
+    }
+    std::sort(fields.begin(), fields.end());
+
+    const uint32_t ifd = (uint32_t)f.size();
+    std::vector<char> arrays;
+    const uint32_t arraysPos = ifd + 2 + 12 * (uint32_t)fields.size() + 4;
+    put16(f, (uint32_t)fields.size(), be);
+    for (const auto &field : fields) {
+        put16(f, field.first, be);
+        put16(f, TIFF_LONG, be);
+        put32(f, (uint32_t)field.second.size(), be);
+        if (field.second.size() == 1) put32(f, field.second[0], be);
+        else {
+            put32(f, arraysPos + (uint32_t)arrays.size(), be);
+            for (uint32_t v : field.second) put32(arrays, v, be);
+        }
+    }
+    put32(f, 0, be);                            // no next IFD
+    f.insert(f.end(), arrays.begin(), arrays.end());
+
+    std::vector<char> offset;
+    put32(offset, ifd, be);
+    std::copy(offset.begin(), offset.end(), f.begin() + 4);
+    return f;
+}
+
+// the image cut into strips, plane after plane
+std::vector<std::vector<char>> cutStrips(const TiffInfo &info, const char* image)
+{
+    std::vector<std::vector<char>> strips(info.planes() * info.stripsPerPlane());
+    for (uint32_t s = 0; s != strips.size(); ++s) {
+        const size_t bytes = (size_t)info.rowsInStrip(s) * info.bytesPerRow();
+        strips[s].assign(image, image + bytes);
+        image += bytes;
+    }
+    return strips;
+}
+
+// the image cut into tiles, tiles across then down, edges padded with zeros
+std::vector<std::vector<char>> cutTiles(const TiffInfo &info, const char* image)
+{
+    const uint32_t rowBytes = info.bytesPerRow();
+    const uint32_t tileRowBytes = info.tileBytesPerRow();
+    const uint32_t pixelBytes = tileRowBytes / info.tileWidth;
+    std::vector<std::vector<char>> tiles(info.tilesPerPlane());
+    for (uint32_t t = 0; t != tiles.size(); ++t) {
+        const uint32_t x = t % info.tilesAcross() * info.tileWidth;
+        const uint32_t y = t / info.tilesAcross() * info.tileLength;
+        const uint32_t bytes = (std::min(x + info.tileWidth, info.width) - x) * pixelBytes;
+        const uint32_t rows = std::min(y + info.tileLength, info.height) - y;
+        tiles[t].resize((size_t)tileRowBytes * info.tileLength);
+        for (uint32_t r = 0; r != rows; ++r)
+            std::memcpy(&tiles[t][(size_t)r * tileRowBytes],
+                        image + (size_t)(y + r) * rowBytes + x * pixelBytes, bytes);
+    }
+    return tiles;
+}
+
+CorpusImage makeImage(const Spec &spec, std::mt19937 &rng)
+{
+    const uint32_t spp = spec.samplesPerPixel;
+    const uint32_t bytes = spec.bitsPerSample / 8;
+    const bool floats = spec.bitsPerSample == 32;   // IEEE floats, smooth content only
+    const uint32_t maxValue = floats ? 0xFF : (1u << spec.bitsPerSample) - 1;
+    const uint32_t rowSamples = width * spp;
+
+    // sample values
+    std::vector<uint32_t> v((size_t)rowSamples * height);
+    for (uint32_t y = 0; y != height; ++y) {
+        for (uint32_t x = 0; x != width; ++x) {
+            for (uint32_t s = 0; s != spp; ++s) {
+                uint32_t value;
+                if (spec.content == CONTENT_NOISE) value = rng() & maxValue;
+                else {
+                    const double level = spec.content == CONTENT_FLAT
+                        ? ((x / 128) * 37 + (y / 96) * 91 + s * 50)
+                        : 32 + x * 0.2 + y * 0.15 + s * 40 + 12 * std::sin(x / 23.0 + s) +
+                          8 * std::cos(y / 17.0) + rng() % 3;
+                    value = (uint32_t)level & 0xFF;
+                    // 16 bit is the same picture with noise in the low byte
+                    if (bytes == 2)
+                        value = value << 8 | (spec.content == CONTENT_SMOOTH ? rng() % 64 : 0);
+                    // floats are the level scaled to about 0 - 1, every mantissa bit set
+                    if (floats) {
+                        const float f = (float)(level / 256);
+                        std::memcpy(&value, &f, 4);
+                    }
+                }
+                v[(size_t)y * rowSamples + x * spp + s] = value;
+            }
+        }
+    }
+
+    CorpusImage image;
+    image.name = spec.name;
+
+    // expected decode, host byte order, plane after plane when planar
+    image.pixels.resize(v.size() * bytes);
+    const size_t planeSamples = (size_t)width * height;
+    for (size_t i = 0; i != v.size(); ++i) {
+        const size_t at = spec.layout == LAYOUT_PLANAR ? i % spp * planeSamples + i / spp : i;
+        if (bytes == 1) image.pixels[at] = (char)v[i];
+        else if (bytes == 2) {
+            const uint16_t s = (uint16_t)v[i];
+            std::memcpy(&image.pixels[at * 2], &s, 2);
+        }
+        else std::memcpy(&image.pixels[at * 4], &v[i], 4);
+    }
+
+    // strips coded with the predictor and byte order of the file
+    TiffInfo info;
+    info.bigEndian = spec.bigEndian;
+    info.width = width;
+    info.height = height;
+    info.bitsPerSample = spec.bitsPerSample;
+    info.samplesPerPixel = spec.samplesPerPixel;
+    info.predictor = !spec.predictor ? PREDICTOR_NONE
+                   : floats ? PREDICTOR_FLOATINGPOINT : PREDICTOR_HORIZONTAL;
+    info.planarConfiguration = spec.layout == LAYOUT_PLANAR ? PLANARCONFIG_SEPARATE : PLANARCONFIG_CONTIG;
+    info.rowsPerStrip = rowsPerStrip;
+    if (spec.layout == LAYOUT_TILED) {
+        info.tiled = true;
+        info.tileWidth = tileSize;
+        info.tileLength = tileSize;
+        image.file = handBuiltTiff(info, cutTiles(info, image.pixels.data()));
+        return image;
+    }
+    if (floats) {
+        image.file = handBuiltTiff(info, cutStrips(info, image.pixels.data()));
+        return image;
+    }
+    std::ostringstream file;
+    writeTiff(file, info, image.pixels.data());
+    const std::string tiff = file.str();
+    image.file.assign(tiff.begin(), tiff.end());
+    return image;
+}
+
+} // namespace
+
+std::vector<CorpusImage> syntheticCorpus()
+{
+    const Spec specs[] = {
+        {"gray8 smooth pred II", 1, 8, CONTENT_SMOOTH, true, false, LAYOUT_CHUNKY},
+        {"gray8 smooth MM", 1, 8, CONTENT_SMOOTH, false, true, LAYOUT_CHUNKY},
+        {"rgb8 smooth pred II", 3, 8, CONTENT_SMOOTH, true, false, LAYOUT_CHUNKY},
+        {"rgb8 smooth MM", 3, 8, CONTENT_SMOOTH, false, true, LAYOUT_CHUNKY},
+        {"rgb8 flat pred MM", 3, 8, CONTENT_FLAT, true, true, LAYOUT_CHUNKY},
+        {"rgb8 noise pred II", 3, 8, CONTENT_NOISE, true, false, LAYOUT_CHUNKY},
+        {"rgb16 smooth pred MM", 3, 16, CONTENT_SMOOTH, true, true, LAYOUT_CHUNKY},
+        {"rgb16 smooth II", 3, 16, CONTENT_SMOOTH, false, false, LAYOUT_CHUNKY},
+        {"gray16 noise pred II", 1, 16, CONTENT_NOISE, true, false, LAYOUT_CHUNKY},
+        {"rgb8 smooth pred planar II", 3, 8, CONTENT_SMOOTH, true, false, LAYOUT_PLANAR},
+        {"rgba16 smooth pred planar MM", 4, 16, CONTENT_SMOOTH, true, true, LAYOUT_PLANAR},
+        {"rgb8 smooth pred tiled II", 3, 8, CONTENT_SMOOTH, true, false, LAYOUT_TILED},
+        {"gray16 smooth pred tiled MM", 1, 16, CONTENT_SMOOTH, true, true, LAYOUT_TILED},
+        {"rgb32f smooth pred II", 3, 32, CONTENT_SMOOTH, true, false, LAYOUT_CHUNKY},
+        {"gray32f smooth pred MM", 1, 32, CONTENT_SMOOTH, true, true, LAYOUT_CHUNKY},
+    };
+    std::mt19937 rng(2024);
+    std::vector<CorpusImage> corpus;
+    for (const Spec &spec : specs) corpus.push_back(makeImage(spec, rng));
+    return corpus;
+}
@@ -0,0 +1,34 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+/*
+    Synthetic benchmark images.  Each one is a complete LZW tiff held in memory, strips,
+    IFD and all, so the decoder reads it exactly like a file from disk.  writeTiff
+    writes the stripped ones; tiled ones and 32 bit floats with the floating point
+    predictor (Predictor = 3), which it cannot write, are put together by hand.  The set
+    covers 8 and 16 bit samples, with and without the horizontal predictor, both byte
+    orders, chunky, planar (PlanarConfiguration = 2) and tiled images with edge tiles,
+    and content from flat (long runs, long strings) through smooth (photo like) to
+    noise (no repeats, the table clears every few thousand bytes).  The images are
+    generated from a fixed seed so every run and every machine benchmarks the same
+    bytes.
+
+    pixels holds the image the decode must give back, laid out like decodeImage writes
+    it: chunky, or plane after plane for a planar image, 16 bit samples and floats in
+    host byte order.
+*/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CorpusImage
+{
+    std::string name;
+    std::vector<char> file;                     // the whole tiff
+    std::vector<char> pixels;                   // expected decode
+};
+
+std::vector<CorpusImage> syntheticCorpus();
+
+#endif // CORPUS_H
@@ -0,0 +1,109 @@
+#include "counters.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(__linux__)
+int openCounter(uint32_t type, uint64_t config)
+{
+    perf_event_attr a;
+    std::memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = type;
+    a.config = config;
+    a.disabled = 1;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(__NR_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+uint64_t readMisses(uint64_t cache)
+{
+    return cache | (uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8 |
+           (uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+}
+#endif
+
+} // namespace
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i != COUNTER_COUNT; ++i) {
+        fd[i] = -1;
+        values[i] = -1;
+    }
+#if defined(__linux__)
+    fd[COUNTER_CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fd[COUNTER_INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fd[COUNTER_BRANCH_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fd[COUNTER_L1D_MISSES] = openCounter(PERF_TYPE_HW_CACHE, readMisses(PERF_COUNT_HW_CACHE_L1D));
+    fd[COUNTER_LLC_MISSES] = openCounter(PERF_TYPE_HW_CACHE, readMisses(PERF_COUNT_HW_CACHE_LL));
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+    for (int i = 0; i != COUNTER_COUNT; ++i) {
+        if (fd[i] >= 0) ::close(fd[i]);
+    }
+#endif
+}
+
+bool PerfCounters::available() const
+{
+    for (int i = 0; i != COUNTER_COUNT; ++i) {
+        if (fd[i] >= 0) return true;
+    }
+    return false;
+}
+
+void PerfCounters::start()
+{
+#if defined(__linux__)
+    for (int i = 0; i != COUNTER_COUNT; ++i) {
+        if (fd[i] < 0) continue;
+        ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+void PerfCounters::stop()
+{
+#if defined(__linux__)
+    for (int i = 0; i != COUNTER_COUNT; ++i) {
+        if (fd[i] >= 0) ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    // value, time enabled, time running
+    for (int i = 0; i != COUNTER_COUNT; ++i) {
+        uint64_t v[3];
+        values[i] = -1;
+        if (fd[i] < 0 || read(fd[i], v, sizeof(v)) != (ssize_t)sizeof(v) || !v[2]) continue;
+        values[i] = (double)v[0] * ((double)v[1] / (double)v[2]);
+    }
+#endif
+}
+
+double PerfCounters::value(Counter c) const
+{
+    return values[c];
+}
+
+const char* PerfCounters::name(Counter c)
+{
+    static const char* const names[COUNTER_COUNT] = {
+        "cycles", "instructions", "branchMisses", "l1dMisses", "llcMisses"
+    };
+    return names[c];
+}
@@ -0,0 +1,46 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+/*
+    Hardware performance counters of the calling thread, user space only, through
+    perf_event_open on Linux.  Each counter is opened on its own and scaled by the time
+    it actually ran, so a CPU with fewer counters than asked for multiplexes them rather
+    than failing.  A counter the CPU or kernel does not offer (a VM, a high
+    perf_event_paranoid) reads -1, as do all of them elsewhere than Linux.
+
+    The generic perf cache events have no L2, so the cache misses counted are L1 data
+    reads and last level reads.  Only the calling thread is counted: profile decodes
+    that run on the caller, not on a ThreadPool.
+*/
+
+enum Counter
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_COUNT
+};
+
+class PerfCounters
+{
+public:
+    PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+    ~PerfCounters();
+
+    bool available() const;                     // at least one counter opened
+    void start();                               // zero and count
+    void stop();
+    double value(Counter c) const;              // from start to stop, -1 if not available
+
+    static const char* name(Counter c);
+
+private:
+    int fd[COUNTER_COUNT];
+    double values[COUNTER_COUNT];
+};
+
+#endif // COUNTERS_H
@@ -0,0 +1,397 @@
+#include "decoder.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+LzwParams lzwParams(const TiffInfo &info, const DecodeOptions &options)
+{
+    LzwParams p;
+    p.bytesPerRow = (int)(info.tiled ? info.tileBytesPerRow() : info.bytesPerRow());
+    int samples = (info.planarConfiguration == PLANARCONFIG_SEPARATE) ? 1 : info.samplesPerPixel;
+    p.stride = samples * info.bitsPerSample / 8;
+    p.predictor = info.predictor == PREDICTOR_HORIZONTAL;
+    p.floatingPoint = info.predictor == PREDICTOR_FLOATINGPOINT;
+    p.bitsPerSample = info.bitsPerSample;
+    p.bigEndian = info.bigEndian;
+    p.engine = options.engine;
+    p.predictorMode = options.predictorMode;
+    p.checked = options.checked;
+    return p;
+}
+
+namespace {
+
+bool interleaved(const TiffInfo &info, const DecodeOptions &options)
+{
+    return options.interleave && info.planes() > 1;
+}
+
+// the horizontal predictor is undone on 8 and 16 bit samples only and the floating
+// point one on 16, 32 and 64 bit, any other depth would come out as garbage
+bool predictorSupported(const TiffInfo &info)
+{
+    const uint32_t bits = info.bitsPerSample;
+    if (info.predictor == PREDICTOR_HORIZONTAL) return bits == 8 || bits == 16;
+    if (info.predictor == PREDICTOR_FLOATINGPOINT) return bits == 16 || bits == 32 || bits == 64;
+    return true;
+}
+
+bool checkStrips(size_t fileSize, const TiffInfo &info, const DecodeOptions &options,
+                 const uint32_t* stripOffsets, const uint32_t* stripByteCounts)
+{
+    if (info.compression != COMPRESSION_LZW) return false;
+    if (!predictorSupported(info)) return false;
+    const uint32_t perPlane = info.tiled ? info.tilesPerPlane() : info.stripsPerPlane();
+    if (info.stripCount > perPlane * info.planes()) return false;
+    if (interleaved(info, options) && info.bitsPerSample % 8) return false;
+    for (uint32_t strip = 0; strip != info.stripCount; ++strip) {
+        if ((uint64_t)stripOffsets[strip] + stripByteCounts[strip] > fileSize) return false;
+    }
+    return true;
+}
+
+// a strip that (checked) held a bad code fails the image; one that ends early only
+// leaves its last rows unset and one with more data than its place fills it, the rest
+// dropped, like a last strip coded padded to the full RowsPerStrip
+bool decoded(const LzwResult &r)
+{
+    return r.status != LZW_BAD_CODE;
+}
+
+// decode buffer of the calling thread, grown as needed and kept for its next task
+char* threadScratch(size_t bytes)
+{
+    static thread_local std::vector<char> scratch;
+    if (scratch.size() < bytes) scratch.resize(bytes);
+    return scratch.data();
+}
+
+// where a strip's rows start in the image, planes follow each other
+size_t stripImageOffset(const TiffInfo &info, uint32_t strip)
+{
+    const uint32_t perPlane = info.stripsPerPlane();
+    const size_t planeBytes = (size_t)info.height * info.bytesPerRow();
+    const size_t bytesPerStrip = (size_t)info.rowsPerStrip * info.bytesPerRow();
+    return (strip / perPlane) * planeBytes + (strip % perPlane) * bytesPerStrip;
+}
+
+// pixel by pixel, one W byte sample from each plane
+template <int W, int Planes>
+void interleave(char* dst, const char* src, size_t planeStride, int planes, size_t count)
+{
+    if (Planes) planes = Planes;
+    for (size_t i = 0; i != count; ++i) {
+        for (int s = 0; s != planes; ++s) {
+            std::memcpy(dst, src + s * planeStride + i * W, W);
+            dst += W;
+        }
+    }
+}
+
+template <int W>
+void interleave(char* dst, const char* src, size_t planeStride, int planes, size_t count)
+{
+    switch (planes) {
+    case 3: interleave<W, 3>(dst, src, planeStride, planes, count); break;
+    case 4: interleave<W, 4>(dst, src, planeStride, planes, count); break;
+    default: interleave<W, 0>(dst, src, planeStride, planes, count);
+    }
+}
+
+void interleave(char* dst, const char* src, size_t planeStride, int planes, size_t count,
+                int bitsPerSample)
+{
+    switch (bitsPerSample) {
+    case 8: interleave<1>(dst, src, planeStride, planes, count); break;
+    case 16: interleave<2>(dst, src, planeStride, planes, count); break;
+    case 32: interleave<4>(dst, src, planeStride, planes, count); break;
+    case 64: interleave<8>(dst, src, planeStride, planes, count); break;
+    }
+}
+
+// a strip or tile: the pixels of the image it holds and its decoded row length
+struct Chunk
+{
+    uint32_t plane;
+    ImageRegion area;                               // rows past the image bottom excluded
+    uint32_t rows;                                  // decoded rows, edge tiles are padded
+    size_t rowBytes;
+};
+
+Chunk chunkAt(const TiffInfo &info, uint32_t pos)
+{
+    Chunk c;
+    if (info.tiled) {
+        const uint32_t perPlane = info.tilesPerPlane();
+        const uint32_t t = pos % perPlane;
+        c.plane = pos / perPlane;
+        c.area.x = t % info.tilesAcross() * info.tileWidth;
+        c.area.y = t / info.tilesAcross() * info.tileLength;
+        c.area.width = std::min(info.tileWidth, info.width - c.area.x);
+        c.area.height = std::min(info.tileLength, info.height - c.area.y);
+        c.rows = info.tileLength;
+        c.rowBytes = info.tileBytesPerRow();
+    }
+    else {
+        const uint32_t perPlane = info.stripsPerPlane();
+        c.plane = pos / perPlane;
+        c.area.x = 0;
+        c.area.y = pos % perPlane * info.rowsPerStrip;
+        c.area.width = info.width;
+        c.area.height = info.rowsInStrip(pos);
+        c.rows = info.rowsPerStrip;
+        c.rowBytes = info.bytesPerRow();
+    }
+    return c;
+}
+
+/*
+    Chunk pos (and the same chunk of the other planes when chunky) decoded into the
+    calling thread's scratch, then the part inside region copied to its place in out,
+    which holds region and is laid out like the image: chunky pixels, or plane after
+    plane.  Decoding stops after the last row in region and the padding of edge tiles
+    is dropped.  The scratch is a whole chunk of every plane, for an image of one
+    strip the whole image.
+*/
+bool decodeChunk(const char* file, const TiffInfo &info, const uint32_t* stripOffsets,
+                 const uint32_t* stripByteCounts, uint32_t pos, const ImageRegion &region,
+                 char* out, const LzwParams &p, bool chunky, LzwDecoderState &state)
+{
+    const Chunk c = chunkAt(info, pos);
+    const uint32_t x0 = std::max(c.area.x, region.x);
+    const uint32_t y0 = std::max(c.area.y, region.y);
+    const uint32_t x1 = std::min(c.area.x + c.area.width, region.x + region.width);
+    const uint32_t y1 = std::min(c.area.y + c.area.height, region.y + region.height);
+    if (x0 >= x1 || y0 >= y1) return true;
+
+    const uint32_t perPlane = info.tiled ? info.tilesPerPlane() : info.stripsPerPlane();
+    const int planes = chunky ? (int)info.planes() : 1;
+    const size_t chunkBytes = c.rowBytes * c.rows;
+    char* scratch = threadScratch(chunkBytes * planes);
+    LzwParams limited = p;
+    limited.outLimit = (y1 - c.area.y) * c.rowBytes;
+    bool ok = true;
+    for (int s = 0; s != planes; ++s) {
+        char* plane = scratch + s * chunkBytes;
+        const uint32_t chunk = (c.plane + s) * perPlane + pos % perPlane;
+        size_t filled = 0;
+        if (chunk < info.stripCount) {
+            const LzwResult r = decompressLZW(file + stripOffsets[chunk], stripByteCounts[chunk],
+                                              plane, chunkBytes, limited, state);
+            ok &= decoded(r);
+            filled = r.bytesWritten;
+        }
+        // a missing plane or a strip that ends early gives zeros, not what an earlier
+        // task left in the scratch
+        if (filled < limited.outLimit) std::memset(plane + filled, 0, limited.outLimit - filled);
+    }
+    const char* src = scratch + (y0 - c.area.y) * c.rowBytes;
+
+    if (chunky) {
+        const size_t sampleBytes = info.bitsPerSample / 8;
+        const size_t pixelBytes = planes * sampleBytes;
+        const size_t rowBytes = region.width * pixelBytes;
+        char* dst = out + (y0 - region.y) * rowBytes + (x0 - region.x) * pixelBytes;
+        src += (x0 - c.area.x) * sampleBytes;
+        for (uint32_t y = y0; y != y1; ++y, dst += rowBytes, src += c.rowBytes)
+            interleave(dst, src, chunkBytes, planes, x1 - x0, info.bitsPerSample);
+        return ok;
+    }
+
+    // in bits for samples under a byte, region and tile edges fall on whole bytes
+    const uint32_t samples = (info.planarConfiguration == PLANARCONFIG_SEPARATE)
+                           ? 1 : info.samplesPerPixel;
+    const uint64_t pixelBits = (uint64_t)samples * info.bitsPerSample;
+    const size_t rowBytes = (size_t)((region.width * pixelBits + 7) / 8);
+    const size_t bytes = (size_t)(((x1 - x0) * pixelBits + 7) / 8);
+    char* dst = out + (size_t)c.plane * region.height * rowBytes + (y0 - region.y) * rowBytes
+                    + (size_t)((x0 - region.x) * pixelBits / 8);
+    src += (size_t)((x0 - c.area.x) * pixelBits / 8);
+    for (uint32_t y = y0; y != y1; ++y, dst += rowBytes, src += c.rowBytes)
+        std::memcpy(dst, src, bytes);
+    return ok;
+}
+
+/*
+    The units of work for a region: the strips or tiles (of every plane when chunky)
+    that intersect it, a range of bands for strips and a block of tiles for tiles.
+*/
+struct Tasks
+{
+    uint32_t across = 1;                            // chunks across the region
+    uint32_t x0 = 0;                                // first chunk column and row
+    uint32_t y0 = 0;
+    uint32_t perPlane = 0;                          // tasks in one plane
+    uint32_t count = 0;
+
+    Tasks(const TiffInfo &info, const ImageRegion &region, bool chunky)
+    {
+        if (!region.width || !region.height) return;
+        const uint32_t chunkWidth = info.tiled ? info.tileWidth : info.width;
+        const uint32_t chunkLength = info.tiled ? info.tileLength : info.rowsPerStrip;
+        x0 = region.x / chunkWidth;
+        y0 = region.y / chunkLength;
+        across = (region.x + region.width - 1) / chunkWidth - x0 + 1;
+        perPlane = across * ((region.y + region.height - 1) / chunkLength - y0 + 1);
+        count = perPlane * (chunky ? 1 : info.planes());
+    }
+
+    // position in the strip table
+    uint32_t chunk(const TiffInfo &info, uint32_t task) const
+    {
+        const uint32_t plane = task / perPlane;
+        const uint32_t t = task % perPlane;
+        const uint32_t x = x0 + t % across;
+        const uint32_t y = y0 + t / across;
+        if (info.tiled) return plane * info.tilesPerPlane() + y * info.tilesAcross() + x;
+        return plane * info.stripsPerPlane() + y;
+    }
+};
+
+ImageRegion wholeImage(const TiffInfo &info)
+{
+    ImageRegion r;
+    r.width = info.width;
+    r.height = info.height;
+    return r;
+}
+
+// whole strips of the whole image go straight into it, everything else via scratch;
+// false when a strip holds a bad code (checked), see decoded
+bool decodeTask(const char* file, const TiffInfo &info, const uint32_t* stripOffsets,
+                const uint32_t* stripByteCounts, const Tasks &tasks, uint32_t task,
+                const ImageRegion &region, char* out, const LzwParams &p, bool chunky,
+                LzwDecoderState &state)
+{
+    const uint32_t pos = tasks.chunk(info, task);
+    if (pos >= info.stripCount) return true;
+    if (!info.tiled && !chunky && region.width == info.width && region.height == info.height) {
+        const size_t bytes = (size_t)info.rowsInStrip(pos) * info.bytesPerRow();
+        return decoded(decompressLZW(file + stripOffsets[pos], stripByteCounts[pos],
+                                     out + stripImageOffset(info, pos), bytes, p, state));
+    }
+    return decodeChunk(file, info, stripOffsets, stripByteCounts, pos, region, out, p, chunky,
+                       state);
+}
+
+// read ahead of the compressed bytes of every task
+void adviseTasks(const char* file, const TiffInfo &info, const uint32_t* stripOffsets,
+                 const uint32_t* stripByteCounts, const Tasks &tasks, bool chunky)
+{
+    const uint32_t planes = chunky ? info.planes() : 1;
+    const uint32_t perPlane = info.tiled ? info.tilesPerPlane() : info.stripsPerPlane();
+    for (uint32_t task = 0; task != tasks.count; ++task) {
+        for (uint32_t s = 0; s != planes; ++s) {
+            const uint32_t pos = tasks.chunk(info, task) + s * perPlane;
+            if (pos >= info.stripCount) break;
+            adviseSequential(file + stripOffsets[pos], stripByteCounts[pos]);
+            adviseWillNeed(file + stripOffsets[pos], stripByteCounts[pos]);
+        }
+    }
+}
+
+bool checkRegion(const TiffInfo &info, const ImageRegion &region)
+{
+    if ((uint64_t)region.x + region.width > info.width) return false;
+    if ((uint64_t)region.y + region.height > info.height) return false;
+    // columns are cut at whole bytes only
+    return region.width == info.width || info.bitsPerSample % 8 == 0;
+}
+
+} // namespace
+
+bool decodeRegion(const char* file, size_t fileSize, const TiffInfo &info,
+                  const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                  const ImageRegion &region, char* out, const DecodeOptions &options)
+{
+    if (!checkStrips(fileSize, info, options, stripOffsets, stripByteCounts)) return false;
+    if (!checkRegion(info, region)) return false;
+    const LzwParams p = lzwParams(info, options);
+    const bool chunky = interleaved(info, options);
+
+    LzwDecoderState &state = LzwDecoderState::threadState();
+    const Tasks tasks(info, region, chunky);
+    if (options.adviseInput)
+        adviseTasks(file, info, stripOffsets, stripByteCounts, tasks, chunky);
+    bool ok = true;
+    for (uint32_t task = 0; task != tasks.count; ++task) {
+        ok &= decodeTask(file, info, stripOffsets, stripByteCounts, tasks, task, region, out, p,
+                         chunky, state);
+    }
+    return ok;
+}
+
+bool decodeRegionParallel(const char* file, size_t fileSize, const TiffInfo &info,
+                          const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                          const ImageRegion &region, char* out, ThreadPool &pool,
+                          const DecodeOptions &options)
+{
+    if (!checkStrips(fileSize, info, options, stripOffsets, stripByteCounts)) return false;
+    if (!checkRegion(info, region)) return false;
+    const LzwParams p = lzwParams(info, options);
+    const bool chunky = interleaved(info, options);
+
+    // pool threads live as long as the pool, so each keeps its code table between calls
+    const Tasks tasks(info, region, chunky);
+    if (options.adviseInput)
+        adviseTasks(file, info, stripOffsets, stripByteCounts, tasks, chunky);
+    std::atomic<bool> ok(true);
+    pool.parallelFor(tasks.count, [&](uint32_t task, int) {
+        if (!decodeTask(file, info, stripOffsets, stripByteCounts, tasks, task, region, out, p,
+                        chunky, LzwDecoderState::threadState()))
+            ok = false;
+    });
+    return ok;
+}
+
+bool decodeImage(const char* file, size_t fileSize, const TiffInfo &info,
+                 const uint32_t* stripOffsets, const uint32_t* stripByteCounts, char* image,
+                 const DecodeOptions &options)
+{
+    return decodeRegion(file, fileSize, info, stripOffsets, stripByteCounts, wholeImage(info),
+                        image, options);
+}
+
+bool decodeImageParallel(const char* file, size_t fileSize, const TiffInfo &info,
+                         const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                         char* image, ThreadPool &pool, const DecodeOptions &options)
+{
+    return decodeRegionParallel(file, fileSize, info, stripOffsets, stripByteCounts,
+                                wholeImage(info), image, pool, options);
+}
+
+bool decodeImageRows(const char* file, size_t fileSize, const TiffInfo &info,
+                     const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                     const ImageRowSink &sink, const DecodeOptions &options)
+{
+    if (info.tiled || interleaved(info, options)) return false;
+    if (!checkStrips(fileSize, info, options, stripOffsets, stripByteCounts)) return false;
+    LzwParams p = lzwParams(info, options);
+
+    const Tasks tasks(info, wholeImage(info), false);
+    if (options.adviseInput)
+        adviseTasks(file, info, stripOffsets, stripByteCounts, tasks, false);
+    LzwDecoderState &state = LzwDecoderState::threadState();
+    const uint32_t perPlane = info.stripsPerPlane();
+    bool stopped = false;
+    bool ok = true;
+    for (uint32_t strip = 0; strip != info.stripCount && !stopped; ++strip) {
+        const uint32_t plane = strip / perPlane;
+        const uint32_t y0 = strip % perPlane * info.rowsPerStrip;
+        const uint32_t rows = info.rowsInStrip(strip);
+        // the rows of the strip and no more, as decodeImage gives it no room for more
+        p.outLimit = (size_t)rows * info.bytesPerRow();
+        const LzwResult r = decompressLZWRows(file + stripOffsets[strip],
+                                              stripByteCounts[strip], p, state,
+                                              [&](const char* row, uint32_t index) {
+            if (index >= rows) return true;
+            stopped = !sink(row, y0 + index, plane);
+            return !stopped;
+        });
+        ok &= decoded(r);
+    }
+    return ok;
+}
@@ -0,0 +1,99 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+/*
+    Whole image decoding.  file points at byte 0 of the tiff held in memory and the strip
+    table is the one filled by readStripTable.  Each strip is decoded by decompressLZW
+    straight into its rows of the caller's image buffer, which must hold
+    info.imageBytes().  Nothing is copied or allocated per strip.  Every strip is decoded
+    with the size of its place as the output capacity: a strip with more data than that
+    (a last strip coded padded to the full RowsPerStrip) fills its place and the excess
+    is dropped, on every path.  16 bit samples and floating point predictor samples come
+    out in host byte order whatever the file's.
+    The horizontal predictor is only undone on 8 and 16 bit samples and the floating
+    point one on 16, 32 and 64 bit, an image with either at any other depth fails rather
+    than decode to wrong pixels.
+
+    Strips are independent (each starts with a CLEAR_CODE and the predictor restarts on
+    every row) so decodeImageParallel farms them out to a ThreadPool.  Workers write
+    disjoint rows of the same image buffer, each with its own LzwDecoderState.
+
+    Planar images (PlanarConfiguration = 2) are decoded plane after plane by default,
+    the layout of the file.  With interleave set every band of rows is decoded plane by
+    plane into a per-thread scratch strip and written out as chunky pixels, so the image
+    is never shuffled as a whole; the bands are the parallel tasks.  Interleave needs
+    whole byte samples.
+
+    Tiled images are decoded tile by tile, each into a per-thread scratch tile and then
+    copied row by row into the image, dropping the padding of edge tiles.  Every tile
+    is a task, which balances far better than strips on big images.  The strip table
+    arguments then hold the TileOffsets and TileByteCounts.
+
+    decodeRegion decodes a rectangle of the image into out, laid out like the image but
+    region.width x region.height.  Only the strips or tiles that intersect it are
+    decoded, and each stops at its last row inside the region (LzwParams::outLimit)
+    instead of running to EOF_CODE.  Regions that cut rows need whole byte samples.
+
+    When file is a MappedFile set adviseInput: before decoding, the kernel is asked to
+    start reading the pages of every strip or tile that will be decoded, and each one is
+    marked for sequential reading, so the first decodes overlap the reads of the rest.
+
+    decodeImageRows streams the image to sink one row at a time, top to bottom and plane
+    after plane, with decompressLZWRows: no image buffer, only a row window per call, for
+    callers that use each row once.  row is good only for the call and is laid out as in
+    decodeImage; returning false stops the decode, which still succeeds.  Rows a short
+    strip does not hold are skipped.  It takes strips only: a row of a tiled image is in
+    every tile across, and interleave is not done.
+
+    Set checked for files from outside: a strip with a code past the LZW table then
+    fails the decode.
+*/
+
+#include "lzw.h"
+#include "threadpool.h"
+#include "tiff.h"
+
+// decoder choices that do not come from the file
+struct DecodeOptions
+{
+    LzwEngine engine = LZW_COPY_TABLE;
+    LzwPredictorMode predictorMode = LZW_PREDICT_FUSED;
+    bool interleave = false;                    // planar images out as chunky pixels
+    bool adviseInput = false;                   // file is a MappedFile, pass access hints
+    bool checked = false;                       // LzwParams::checked, for untrusted files
+};
+
+// rectangle of the image in pixels
+struct ImageRegion
+{
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+LzwParams lzwParams(const TiffInfo &info, const DecodeOptions &options = DecodeOptions());
+
+bool decodeImage(const char* file, size_t fileSize, const TiffInfo &info,
+                 const uint32_t* stripOffsets, const uint32_t* stripByteCounts, char* image,
+                 const DecodeOptions &options = DecodeOptions());
+bool decodeImageParallel(const char* file, size_t fileSize, const TiffInfo &info,
+                         const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                         char* image, ThreadPool &pool,
+                         const DecodeOptions &options = DecodeOptions());
+// row y of plane, info.bytesPerRow() bytes; return false to stop
+typedef std::function<bool(const char* row, uint32_t y, uint32_t plane)> ImageRowSink;
+
+bool decodeImageRows(const char* file, size_t fileSize, const TiffInfo &info,
+                     const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                     const ImageRowSink &sink, const DecodeOptions &options = DecodeOptions());
+bool decodeRegion(const char* file, size_t fileSize, const TiffInfo &info,
+                  const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                  const ImageRegion &region, char* out,
+                  const DecodeOptions &options = DecodeOptions());
+bool decodeRegionParallel(const char* file, size_t fileSize, const TiffInfo &info,
+                          const uint32_t* stripOffsets, const uint32_t* stripByteCounts,
+                          const ImageRegion &region, char* out, ThreadPool &pool,
+                          const DecodeOptions &options = DecodeOptions());
+
+#endif // DECODER_H
@@ -0,0 +1,788 @@
+/*
+    Decompress a tiff strip that has LZW Prediction compression.  The strip is an array
+    of bytes RGBRGB... and starts with a CLEAR_CODE, so every strip can be decoded on its
+    own.
+
+    The algorithm to decompress LZW (from TIFF6 Specification):
+
+    while ((Code = GetNextCode()) != EoiCode) {
+        if (Code == ClearCode) {
+            InitializeTable();
+            Code = GetNextCode();
+            if (Code == EoiCode)
+                break;
+            WriteString(StringFromCode(Code));
+            OldCode = Code;
+        } // end of ClearCode case
+        else {
+            if (IsInTable(Code)) {
+                WriteString(StringFromCode(Code));
+                AddStringToTable(StringFromCode(OldCode)+FirstChar(StringFromCode(Code)));
+                OldCode = Code;
+            } else {
+                OutString = StringFromCode(OldCode) + FirstChar(StringFromCode(OldCode));
+                WriteString(OutString);
+                AddStringToTable(OutString);
+                OldCode = Code;
+            }
+        } // end of not-ClearCode case
+    } // end of while loop
+
+    The prediction variant uses the difference between row pixels for the code value.
+
+    This is my third version.  The first version input a stream, overloaded the >>
+    operator, and used string and QByteArray functions.  It took 130 ms to decompress
+    the strip.  The second version ditched the >> overloading and the stream, working
+    directly with the QByteArrays, and took 80ms.  The third run (this one) elimimates
+    all string and QByteArray functions, using byte arrays and pointers, running in
+    3.3 ms.
+
+    Things that have not helped:
+
+    - do basic lzw decompression and make a second pass to do prediction increment.
+    - use pointer instead or array indice to output char string for code.
+
+    Alternatives to std::memcpy
+
+        // option for byte-by-byte
+
+        char* pDst = s[nextCode];
+        char* pSrc = (char*)&ps;
+        for (size_t i = 0; i != psLen; ++i) pDst[i] = pSrc[i];
+
+        // or
+
+        char* pDst = s[nextCode];
+        char* pSrc = (char*)&ps;
+        size_t len = psLen;
+        while (len--)
+        {
+            *pDst++ = *pSrc++;
+        }
+
+        // option for 4 bytes at a time
+
+        uint32_t* pDst = (uint32_t*)s[nextCode];
+        uint32_t* pSrc = (uint32_t*)&ps;
+        size_t len = psLen / 4 + 1;
+        for (size_t i = 0; i != len; ++i) pDst[i] = pSrc[i];
+
+
+*/
+
+#include "lzw.h"
+#include "predictor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+LzwDecoderState::LzwDecoderState()
+    : strings(new char[LZW_STRINGS_SIZE])           // not zeroed, pages are touched as used
+{
+    for (int i = 0 ; i != 256 ; i++ ) sLen[i] = 1;  // 0-255 one char strings
+    // initialize first 256 code strings
+    for (int i = 0 ; i != 256 ; i++ ) {
+        strings[i] = (char)i;
+        s[i] = &strings[i];
+        prefix[i] = 0;
+        suffix[i] = (uint8_t)i;
+        first[i] = (uint8_t)i;
+        length[i] = 1;
+    }
+    strings[256] = 0;  s[256] = &strings[256];      // Clear code
+    strings[257] = 0;  s[257] = &strings[257];      // EOF code
+}
+
+LzwDecoderState &LzwDecoderState::threadState()
+{
+    // heap allocated so the table does not sit in the thread's TLS block or stack
+    static thread_local std::unique_ptr<LzwDecoderState> state;
+    if (!state) state.reset(new LzwDecoderState);
+    return *state;
+}
+
+namespace {
+
+inline uint64_t load64BigEndian(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return v;
+#elif defined(_MSC_VER)
+    return _byteswap_uint64(v);
+#else
+    return __builtin_bswap64(v);
+#endif
+}
+
+/*
+    Codes are packed MSB first.  Instead of shifting in one byte at a time (and testing
+    twice per code) the reader loads 8 bytes big endian in one go, so one refill holds at
+    least 56 bits, four or more codes.  Bits past nBits in buf are the true next bits of
+    the strip (the part of the last byte not yet counted), so OR-ing the next load over
+    them is harmless.  The last 7 bytes of the strip are read one at a time.
+*/
+struct BitReader
+{
+    const uint8_t* c;                               // next byte to load
+    const uint8_t* end;
+    uint64_t buf = 0;                               // next code in the top bits
+    uint32_t nBits = 0;                             // valid bits in buf
+
+    BitReader(const char* in, size_t inLength)
+        : c((const uint8_t*)in), end((const uint8_t*)in + inLength) {}
+
+    void refill()
+    {
+        if (end - c >= 8) {
+            buf |= load64BigEndian(c) >> nBits;
+            c += (63 - nBits) >> 3;
+            nBits |= 56;
+        }
+        else {
+            while (nBits <= 56 && c < end) {
+                buf |= (uint64_t)*c++ << (56 - nBits);
+                nBits += 8;
+            }
+        }
+    }
+
+    // false when the strip has less than a whole code left
+    bool next(uint32_t codeBits, uint32_t &code)
+    {
+        if (nBits < codeBits) {
+            refill();
+            if (nBits < codeBits) return false;
+        }
+        code = (uint32_t)(buf >> (64 - codeBits));
+        buf <<= codeBits;
+        nBits -= codeBits;
+        return true;
+    }
+};
+
+// LzwStats::lengths bin of a string length, floor(log2(len)); longer strings than LZW
+// makes only come from a damaged strip, they go in the last bin
+inline int lengthBin(uint32_t len)
+{
+    int bin = 0;
+    while (len >>= 1) ++bin;
+    return std::min(bin, 11);
+}
+
+// predictor stage, a template argument of the engines so the decode loops test nothing
+enum
+{
+    PREDICT_NONE,
+    PREDICT_FUSED,
+    PREDICT_ROWS
+};
+
+/*
+    Fused predictor for one string of len bytes from src (may be out).  rowPos is where
+    out sits in its row and carries over from string to string, so there is no
+    n % bytesPerRow per byte: a string is split at most at row and first pixel
+    boundaries and each piece runs through predictRun8 with the previous pixel in
+    registers.  S is the stride when it is known at compile time (samples per pixel of
+    an 8 bit image), 0 takes it from stride.
+*/
+template <int S>
+inline void predictString(char* out, const char* src, uint32_t len, uint32_t &rowPos,
+                          uint32_t stride, uint32_t bytesPerRow)
+{
+    if (S) stride = S;
+    while (len) {
+        uint32_t k;
+        if (rowPos < stride) {
+            // first pixel of the row is stored as is
+            k = std::min(len, stride - rowPos);
+            for (uint32_t i = 0; i != k; ++i) out[i] = src[i];
+        }
+        else {
+            k = std::min(len, bytesPerRow - rowPos);
+            if (S) predictRun8<S>(out, src, k);
+            else predictRun8(out, src, k, (int)stride);
+        }
+        out += k;
+        src += k;
+        len -= k;
+        rowPos += k;
+        if (rowPos == bytesPerRow) rowPos = 0;
+    }
+}
+
+/*
+    Row deferred predictor: the strip is decoded raw and each row is undone as soon as
+    its last byte is written, while it is still in L1.  A short last row (truncated
+    strip) is undone by finish.  The stage is the 8 or 16 bit or floating point
+    predictor, or for 16 bit rows without one just the byte order conversion, and is a
+    template argument so each row is a direct call.
+*/
+struct RowNone
+{
+    static void run(char*, size_t, int) {}
+};
+
+struct RowPredict8
+{
+    static void run(char* row, size_t bytes, int stride)
+    {
+        undoHorizontalPredictor8(row, bytes, stride);
+    }
+};
+
+template <bool Swap>
+struct RowPredict16
+{
+    static void run(char* row, size_t bytes, int stride)
+    {
+        undoHorizontalPredictor16(row, bytes, stride, Swap);
+    }
+};
+
+struct RowSwap16
+{
+    static void run(char* row, size_t bytes, int) { swapBytes16(row, bytes); }
+};
+
+template <int W>
+struct RowFloat
+{
+    static void run(char* row, size_t bytes, int stride)
+    {
+        undoFloatingPointPredictor(row, bytes, stride, W);
+    }
+};
+
+template <class Stage>
+struct RowPredictor
+{
+    char* rowStart;
+    size_t bytesPerRow;
+    int stride;                                     // in samples
+
+    RowPredictor(char* out, const LzwParams &p)
+        : rowStart(out), bytesPerRow((size_t)p.bytesPerRow),
+          stride(p.bitsPerSample > 8 ? p.stride / (p.bitsPerSample / 8) : p.stride) {}
+
+    void advance(const char* out)
+    {
+        while ((size_t)(out - rowStart) >= bytesPerRow) {
+            Stage::run(rowStart, bytesPerRow, stride);
+            rowStart += bytesPerRow;
+        }
+    }
+    void finish(const char* out)
+    {
+        if (out > rowStart) Stage::run(rowStart, (size_t)(out - rowStart), stride);
+    }
+};
+
+/*
+    Row window of decompressLZWRows.  The copy table engine decodes into it as if it were
+    the strip and, once a string completes a row, flush hands the whole rows to the sink
+    and moves the part row after them to the front.  The window holds a row plus the
+    longest string, so the next string always fits behind a part row, and the fused
+    predictor still finds the previous pixel of the row right before out.
+*/
+struct RowStream
+{
+    char* window;
+    size_t bytesPerRow;
+    const LzwRowSink &sink;
+    uint32_t row = 0;                               // index of the next row
+    size_t flushed = 0;                             // bytes handed on and gone from window
+    bool stopped = false;                           // the sink returned false
+
+    RowStream(char* window, size_t bytesPerRow, const LzwRowSink &sink)
+        : window(window), bytesPerRow(bytesPerRow), sink(sink) {}
+
+    // returns where out is once the part row has moved to the front
+    char* flush(char* out)
+    {
+        char* r = window;
+        while ((size_t)(out - r) >= bytesPerRow && !stopped) {
+            stopped = !sink(r, row++);
+            r += bytesPerRow;
+        }
+        const size_t rest = (size_t)(out - r);
+        std::memmove(window, r, rest);
+        flushed += (size_t)(r - window);
+        return window + rest;
+    }
+};
+
+template <int Predict, int Samples, class Stage, bool Checked, bool Stats, bool Stream>
+LzwResult decodeCopyTable(const char* in, size_t inLength, char* out, size_t outCapacity,
+                          const LzwParams &p, LzwDecoderState &state, LzwStats* stats,
+                          RowStream* stream)
+/*
+    Strips of a planar image (planarConfiguration = 2) hold one sample per pixel, the
+    decoder gives them a stride of one sample.  With Stream out is the row window of
+    stream and rows leave it as they complete.
+*/
+{
+    const uint32_t bytesPerRow = (uint32_t)p.bytesPerRow;
+    const uint32_t stride = (uint32_t)p.stride;
+    uint32_t rowPos = 0;                            // fused predictor position in the row
+    RowPredictor<Stage> rows(out, p);
+    const size_t outLimit = p.outLimit ? p.outLimit : SIZE_MAX;
+    char* const outEnd = out + outCapacity;
+
+    char* const outStart = out;
+    LzwStatus status = LZW_INPUT_END;
+    BitReader bits(in, inLength);                   // incoming codes
+
+    // code table, codes 0-257 are preset by the LzwDecoderState constructor and never
+    // change, a CLEAR_CODE only rewinds nextCode and sEnd
+    char** s = state.s;                             // ptrs in strings for each possible code
+    uint16_t* sLen = state.sLen;                    // code string length (up to 4094)
+    const uint32_t maxCode = 4095;                  // max for 12 bits
+    char* sEnd = s[257];                            // ptr to current end of strings
+
+    // previous string, strings do not move until the table is reset so this points at
+    // the table entry instead of holding a copy
+    const char* ps = s[0];
+    size_t psLen = 0;                               // length of prevString
+    uint32_t code;                                  // key to string for code
+    uint32_t nextCode = 258;                        // used to preset string for next
+    uint32_t codeBits = 9;                          // number of bits to make code (9-12)
+    uint32_t nextBump = 511;                        // when to increment code size 1st time
+
+    // GetNextCode until the strip runs out of whole codes
+    while (bits.next(codeBits, code)) {
+        if (Stats) ++stats->codes;
+
+        // rest at start and when codes = max ~+ 4094
+        if (code == CLEAR_CODE) {
+            if (Stats) ++stats->clears;
+            codeBits = 9;
+            nextBump = 511;
+            sEnd = s[257];
+            nextCode = 258;
+            psLen = 0;
+            continue;
+        }
+
+        // finished (should not need as the strip runs out of codes)
+        if (code == EOF_CODE) {
+            status = LZW_OK;
+            break;
+        }
+
+        // only codes in the table, or the next one right after a string
+        // unchecked, a bad code is taken as the next one (a byte after a clear), so only
+        // strings of this table are read and they stay as short as the storage assumes
+        const bool kwkwk = code == nextCode && psLen;   // before a bad code is taken
+        if (code > nextCode || (code == nextCode && !psLen)) {
+            if (Checked) {
+                status = LZW_BAD_CODE;
+                break;
+            }
+            code = psLen ? nextCode : 0;
+        }
+
+        // new code then add prevString + prevString[0]
+        // copy prevString
+        if (code == nextCode) {
+            s[code] = sEnd;
+            std::memcpy(s[code], ps, psLen);
+
+            // copy prevString[0]
+            *(s[code] + psLen) = ps[0];
+            sLen[code] = (uint16_t)(psLen + 1);
+            sEnd = s[code] + psLen + 1;
+        }
+
+        const uint32_t len = sLen[code];
+        if (len > (size_t)(outEnd - out)) {
+            // the part that fits, so a strip with more data than its place still fills it
+            const uint32_t k = (uint32_t)(outEnd - out);
+            if (Predict == PREDICT_FUSED)
+                predictString<Samples>(out, s[code], k, rowPos, stride, bytesPerRow);
+            else std::memcpy(out, s[code], k);
+            out += k;
+            if (Predict == PREDICT_ROWS) rows.advance(out);
+            status = LZW_OUTPUT_FULL;
+            break;
+        }
+        if (Stats) {
+            if (kwkwk) ++stats->kwkwk;
+            ++stats->lengths[lengthBin(len)];
+        }
+        if (Predict == PREDICT_FUSED) {
+            predictString<Samples>(out, s[code], len, rowPos, stride, bytesPerRow);
+            out += len;
+        }
+        else if (len > 8) {
+            // long runs (flat backgrounds, masks) go out in one wide copy
+            std::memcpy(out, s[code], len);
+            out += len;
+        }
+        else {
+            for (uint32_t i = 0; i != len; i++) {
+                *out++ = *(s[code] + i);
+            }
+        }
+        if (Predict == PREDICT_ROWS) rows.advance(out);
+        if (Stream && (size_t)(out - outStart) >= bytesPerRow) {
+            out = stream->flush(out);
+            rows.rowStart = outStart;
+            if (stream->stopped) {
+                status = LZW_OUTPUT_LIMIT;
+                break;
+            }
+        }
+        if ((size_t)(out - outStart) + (Stream ? stream->flushed : 0) >= outLimit) {
+            status = LZW_OUTPUT_LIMIT;
+            break;
+        }
+
+        // add string to nextCode (prevString + strings[code][0]), already done above
+        // when code was nextCode
+        // copy prevString
+        if (psLen && code != nextCode && nextCode <= maxCode) {
+            s[nextCode] = sEnd;
+            std::memcpy(s[nextCode], ps, psLen);
+
+            // copy strings[code][0]
+            *(s[nextCode] + psLen) = *s[code];
+
+            sLen[nextCode] = (uint16_t)(psLen + 1);
+            sEnd = s[nextCode] + psLen + 1;
+        }
+        // a valid stream clears the table before it is full, a damaged one may not: the
+        // table stops at 4096 codes either way, checked or not
+        if (psLen && nextCode <= maxCode) {
+            ++nextCode;
+            if (Stats && nextCode == maxCode + 1) ++stats->tableFulls;
+        }
+
+        // this string is the next prevString
+        ps = s[code];
+        psLen = len;
+
+        // codeBits change, 12 bits is the widest so nextBump stops at 4095
+        if (nextCode == nextBump && nextCode < maxCode) {
+            nextBump = (nextBump << 1) + 1;
+            ++codeBits;
+        }
+
+    } // end while}
+
+    if (Predict == PREDICT_ROWS) rows.finish(out);
+    return {status, (size_t)(out - outStart) + (Stream ? stream->flushed : 0)};
+}
+
+// the first k bytes of the string of code (len bytes), for a string that does not fit
+void chainHead(const LzwDecoderState &state, uint32_t code, uint32_t oldCode,
+               uint32_t nextCode, uint32_t len, char* out, uint32_t k)
+{
+    uint32_t walk = code;
+    uint32_t n = len;                               // after the byte written next
+    if (code >= nextCode) {
+        if (--n < k) out[n] = (char)state.first[oldCode];
+        walk = oldCode;
+    }
+    while (walk > 255) {
+        if (--n < k) out[n] = (char)state.suffix[walk];
+        walk = state.prefix[walk];
+    }
+    if (k) out[0] = (char)walk;
+}
+
+template <int Predict, int Samples, class Stage, bool Checked, bool Stats>
+LzwResult decodePrefixChain(const char* in, size_t inLength, char* out, size_t outCapacity,
+                            const LzwParams &p, LzwDecoderState &state, LzwStats* stats,
+                            RowStream*)
+/*
+    Same bit reading and code size rules as decodeCopyTable, but a new code only stores
+    its prefix code, its last byte, the first byte of the string, the length and where
+    the string starts in the output: 10 bytes per code instead of a copy of the whole
+    string.  Strings are written backward into the output by walking the prefix chain,
+    then the predictor runs forward over them.
+
+    Without a predictor the output holds every string in the table as it was decoded: a
+    new code is the previous string followed by the first byte of the current one, and
+    those sit next to each other in the output.  So instead of walking the chain the
+    string is copied from where it starts in the output, which turns long runs into
+    plain memcpy calls.
+*/
+{
+    const uint32_t bytesPerRow = (uint32_t)p.bytesPerRow;
+    const uint32_t stride = (uint32_t)p.stride;
+    uint32_t rowPos = 0;                            // fused predictor position in the row
+    RowPredictor<Stage> rows(out, p);
+    const size_t outLimit = p.outLimit ? p.outLimit : SIZE_MAX;
+    char* const outEnd = out + outCapacity;
+    LzwStatus status = LZW_INPUT_END;
+
+    uint16_t* prefix = state.prefix;                // code of the string less its last byte
+    uint8_t* suffix = state.suffix;                 // last byte of the string
+    uint8_t* first = state.first;                   // first byte of the string
+    uint16_t* length = state.length;                // string length
+    uint32_t* offset = state.offset;                // string start in the output
+    const uint32_t maxCode = 4095;                  // max for 12 bits
+
+    BitReader bits(in, inLength);                   // incoming codes
+    char* const outStart = out;
+    char* prevOut = out;                            // where the previous string went
+    uint32_t code;                                  // key to string for code
+    uint32_t oldCode = CLEAR_CODE;                  // previous code, CLEAR_CODE if none
+    uint32_t nextCode = 258;                        // next code to add to the table
+    uint32_t codeBits = 9;                          // number of bits to make code (9-12)
+    uint32_t nextBump = 511;                        // when to increment code size 1st time
+
+    while (bits.next(codeBits, code)) {
+        if (Stats) ++stats->codes;
+
+        if (code == CLEAR_CODE) {
+            if (Stats) ++stats->clears;
+            codeBits = 9;
+            nextBump = 511;
+            nextCode = 258;
+            oldCode = CLEAR_CODE;
+            continue;
+        }
+        if (code == EOF_CODE) {
+            status = LZW_OK;
+            break;
+        }
+        const bool kwkwk = code == nextCode && oldCode != CLEAR_CODE;
+        if (code > nextCode || (code == nextCode && oldCode == CLEAR_CODE)) {
+            if (Checked) {
+                status = LZW_BAD_CODE;
+                break;
+            }
+            code = oldCode != CLEAR_CODE ? nextCode : 0;
+        }
+
+        // string length and, for code == nextCode (KwKwK), the string is the old string
+        // plus its own first byte
+        const uint32_t len = code < nextCode ? length[code] : length[oldCode] + 1;
+        if (len > (size_t)(outEnd - out)) {
+            const uint32_t k = (uint32_t)(outEnd - out);
+            chainHead(state, code, oldCode, nextCode, len, out, k);
+            if (Predict == PREDICT_FUSED)
+                predictString<Samples>(out, out, k, rowPos, stride, bytesPerRow);
+            out += k;
+            if (Predict == PREDICT_ROWS) rows.advance(out);
+            status = LZW_OUTPUT_FULL;
+            break;
+        }
+        if (Stats) {
+            if (kwkwk) ++stats->kwkwk;
+            ++stats->lengths[lengthBin(len)];
+        }
+        if (Predict != PREDICT_NONE) {
+            uint32_t walk = code;
+            uint8_t* e = (uint8_t*)out + len;
+            if (code >= nextCode) {
+                *--e = first[oldCode];
+                walk = oldCode;
+            }
+
+            // write the string backward from its last byte
+            while (walk > 255) {
+                *--e = suffix[walk];
+                walk = prefix[walk];
+            }
+            *--e = (uint8_t)walk;
+        }
+        else {
+            if (code < 256) {
+                *out = (char)code;
+            }
+            else if (code < nextCode) {
+                std::memcpy(out, outStart + offset[code], len);
+            }
+            else {
+                // the old string ends right where this one starts
+                std::memcpy(out, prevOut, len - 1);
+                out[len - 1] = *prevOut;
+            }
+        }
+
+        // add old string + first byte of this string
+        if (oldCode != CLEAR_CODE && nextCode <= maxCode) {
+            prefix[nextCode] = (uint16_t)oldCode;
+            suffix[nextCode] = (uint8_t)*out;
+            first[nextCode] = first[oldCode];
+            length[nextCode] = (uint16_t)(length[oldCode] + 1);
+            offset[nextCode] = (uint32_t)(prevOut - outStart);
+            ++nextCode;
+            if (Stats && nextCode == maxCode + 1) ++stats->tableFulls;
+        }
+        oldCode = code;
+        prevOut = out;
+
+        if (Predict == PREDICT_FUSED)
+            predictString<Samples>(out, out, len, rowPos, stride, bytesPerRow);
+        out += len;
+        if (Predict == PREDICT_ROWS) rows.advance(out);
+        if ((size_t)(out - outStart) >= outLimit) {
+            status = LZW_OUTPUT_LIMIT;
+            break;
+        }
+
+        // codeBits change, 12 bits is the widest so nextBump stops at 4095
+        if (nextCode == nextBump && nextCode < maxCode) {
+            nextBump = (nextBump << 1) + 1;
+            ++codeBits;
+        }
+    }
+
+    if (Predict == PREDICT_ROWS) rows.finish(out);
+    return {status, (size_t)(out - outStart)};
+}
+
+typedef LzwResult (*Engine)(const char*, size_t, char*, size_t, const LzwParams &,
+                            LzwDecoderState &, LzwStats*, RowStream*);
+
+// a row stream always takes the copy table, the prefix chain reads back from the output
+template <int Predict, int Samples, class Stage, bool Checked, bool Stats, bool Stream>
+Engine engine(bool chain)
+{
+    return chain && !Stream ? decodePrefixChain<Predict, Samples, Stage, Checked, Stats>
+                            : decodeCopyTable<Predict, Samples, Stage, Checked, Stats, Stream>;
+}
+
+/*
+    The decode loop for the params, picked once per strip from what the IFD gave.  Every
+    combination of predictor, bit depth and byte order that needs a stage gets its own
+    instantiation, and the fused 8 bit predictor one per samples per pixel up to 4, so
+    the loop for any real file tests none of it per code.  The fused stage is 8 bit
+    integer only, wider samples can straddle strings.  The horizontal predictor at other
+    depths than 8 and 16 bit and the floating point one at other depths than 16, 32 and
+    64 bit are not supported, the decoder refuses such files before they get here
+    (checkStrips in decoder.cpp).
+*/
+template <bool Checked, bool Stats, bool Stream = false>
+Engine pickEngine(const LzwParams &p)
+{
+    const bool chain = p.engine == LZW_PREFIX_CHAIN;
+    if (p.floatingPoint) {
+        switch (p.bitsPerSample) {
+        case 16: return engine<PREDICT_ROWS, 0, RowFloat<2>, Checked, Stats, Stream>(chain);
+        case 32: return engine<PREDICT_ROWS, 0, RowFloat<4>, Checked, Stats, Stream>(chain);
+        case 64: return engine<PREDICT_ROWS, 0, RowFloat<8>, Checked, Stats, Stream>(chain);
+        default: return engine<PREDICT_NONE, 0, RowNone, Checked, Stats, Stream>(chain);
+        }
+    }
+    if (p.bitsPerSample == 16) {
+        const bool swap = p.bigEndian != hostBigEndian();
+        if (p.predictor)
+            return swap ? engine<PREDICT_ROWS, 0, RowPredict16<true>, Checked, Stats, Stream>(chain)
+                        : engine<PREDICT_ROWS, 0, RowPredict16<false>, Checked, Stats, Stream>(chain);
+        return swap ? engine<PREDICT_ROWS, 0, RowSwap16, Checked, Stats, Stream>(chain)
+                    : engine<PREDICT_NONE, 0, RowNone, Checked, Stats, Stream>(chain);
+    }
+    if (!p.predictor) return engine<PREDICT_NONE, 0, RowNone, Checked, Stats, Stream>(chain);
+    if (p.predictorMode == LZW_PREDICT_ROWS || p.bitsPerSample != 8)
+        return engine<PREDICT_ROWS, 0, RowPredict8, Checked, Stats, Stream>(chain);
+    switch (p.stride) {
+    case 1: return engine<PREDICT_FUSED, 1, RowNone, Checked, Stats, Stream>(chain);
+    case 2: return engine<PREDICT_FUSED, 2, RowNone, Checked, Stats, Stream>(chain);
+    case 3: return engine<PREDICT_FUSED, 3, RowNone, Checked, Stats, Stream>(chain);
+    case 4: return engine<PREDICT_FUSED, 4, RowNone, Checked, Stats, Stream>(chain);
+    default: return engine<PREDICT_FUSED, 0, RowNone, Checked, Stats, Stream>(chain);
+    }
+}
+
+} // namespace
+
+LzwResult decompressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                        const LzwParams &p, LzwDecoderState &state)
+{
+    const Engine decode = p.checked ? pickEngine<true, false>(p) : pickEngine<false, false>(p);
+    return decode(in, inLength, out, outCapacity, p, state, nullptr, nullptr);
+}
+
+LzwResult decompressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                        const LzwParams &p, LzwDecoderState &state, LzwStats &stats)
+{
+    const Engine decode = p.checked ? pickEngine<true, true>(p) : pickEngine<false, true>(p);
+    const LzwResult r = decode(in, inLength, out, outCapacity, p, state, &stats, nullptr);
+    ++stats.strips;
+    stats.inputBytes += inLength;
+    stats.outputBytes += r.bytesWritten;
+    return r;
+}
+
+LzwResult decompressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                        const LzwParams &p)
+{
+    return decompressLZW(in, inLength, out, outCapacity, p, LzwDecoderState::threadState());
+}
+
+LzwResult decompressLZW(const std::vector<char> &in, std::vector<char> &out, const LzwParams &p)
+{
+    return decompressLZW(in.data(), in.size(), out.data(), out.size(), p);
+}
+
+LzwResult decompressLZWRows(const char* in, size_t inLength, const LzwParams &p,
+                            LzwDecoderState &state, const LzwRowSink &sink)
+{
+    if (p.bytesPerRow <= 0) return {LZW_OUTPUT_FULL, 0};
+    const size_t bytesPerRow = (size_t)p.bytesPerRow;
+    const size_t windowBytes = bytesPerRow + 4096;  // a part row and the longest string
+    if (state.rows.size() < windowBytes) state.rows.resize(windowBytes);
+
+    RowStream stream(state.rows.data(), bytesPerRow, sink);
+    const Engine decode = p.checked ? pickEngine<true, false, true>(p)
+                                    : pickEngine<false, false, true>(p);
+    const LzwResult r = decode(in, inLength, stream.window, windowBytes, p, state, nullptr,
+                               &stream);
+
+    // the strip ended inside a row, already through the predictor
+    const size_t part = r.bytesWritten - stream.flushed;
+    if (part && (r.status == LZW_OK || r.status == LZW_INPUT_END)) {
+        std::memset(stream.window + part, 0, bytesPerRow - part);
+        sink(stream.window, stream.row);
+    }
+    return r;
+}
+
+LzwResult decompressLZWRows(const char* in, size_t inLength, const LzwParams &p,
+                            const LzwRowSink &sink)
+{
+    return decompressLZWRows(in, inLength, p, LzwDecoderState::threadState(), sink);
+}
+
+size_t countLzwCodes(const char* in, size_t inLength)
+{
+    BitReader bits(in, inLength);
+    const uint32_t maxCode = 4095;
+    uint32_t code;
+    uint32_t oldCode = CLEAR_CODE;
+    uint32_t nextCode = 258;
+    uint32_t codeBits = 9;
+    uint32_t nextBump = 511;
+    size_t codes = 0;
+
+    // the code size rules of the decoders, with no table behind them
+    while (bits.next(codeBits, code)) {
+        ++codes;
+        if (code == CLEAR_CODE) {
+            codeBits = 9;
+            nextBump = 511;
+            nextCode = 258;
+            oldCode = CLEAR_CODE;
+            continue;
+        }
+        if (code == EOF_CODE) break;
+        if (oldCode != CLEAR_CODE && nextCode <= maxCode) ++nextCode;
+        oldCode = code;
+        if (nextCode == nextBump && nextCode < maxCode) {
+            nextBump = (nextBump << 1) + 1;
+            ++codeBits;
+        }
+    }
+    return codes;
+}
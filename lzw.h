@@ -0,0 +1,182 @@
+#ifndef LZW_H
+#define LZW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+const unsigned int CLEAR_CODE = 256;
+const unsigned int EOF_CODE = 257;
+const unsigned int MAXCODE = 4095;      // 12 bit max less some head room
+
+// String storage for the copy table.  In the worst case (a flat run) every code is one
+// byte longer than the one before, 2 + 3 + ... + 3839 bytes, with room to spare.
+#define LZW_STRINGS_SIZE (4096 * 4096 / 2)
+
+// Code table layouts, see decodeCopyTable and decodePrefixChain in lzw.cpp
+enum LzwEngine
+{
+    LZW_COPY_TABLE,                             // every code keeps a copy of its string
+    LZW_PREFIX_CHAIN                            // every code keeps prefix code + last byte
+};
+
+// where the horizontal predictor is undone, 16 bit and float samples always use rows
+enum LzwPredictorMode
+{
+    LZW_PREDICT_FUSED,                          // as each string is written
+    LZW_PREDICT_ROWS                            // on each row once it is complete
+};
+
+struct LzwParams
+{
+    int bytesPerRow = 0;                        // row length of the decoded strip
+    int stride = 1;                             // bytes between predicted samples
+    bool predictor = false;                     // horizontal differencing (Predictor = 2)
+    bool floatingPoint = false;                 // floating point differencing (Predictor = 3)
+    int bitsPerSample = 8;                      // 8 or 16, floats 16, 32 or 64
+    bool bigEndian = false;                     // file byte order, 16 bit output is in host order
+    size_t outLimit = 0;                        // stop once this many bytes are out, 0 = no limit
+    bool checked = false;                       // reject codes not yet in the table
+    LzwEngine engine = LZW_COPY_TABLE;
+    LzwPredictorMode predictorMode = LZW_PREDICT_FUSED;
+};
+
+/*
+    Code tables for decompressLZW.  The string storage is sized for the longest strings
+    LZW can make (4094 bytes), about 8 MB, far too big for the stack of a worker thread,
+    so it lives on the heap and is built once: codes 0-257 are set up by the constructor
+    and a CLEAR_CODE only rewinds the end of the table.  Only the pages the strings
+    actually reach are ever touched.  Reusing one state for every strip a thread decodes
+    means no allocation per strip, and the pages touched so far are already mapped for
+    the next one.  threadState() returns a state owned by the calling thread.
+
+    The prefix chain arrays are the compact layout for LZW_PREFIX_CHAIN, 10 bytes per
+    code and 40 KB in all, the offsets of strings in the output taking 16 KB of it.
+*/
+struct LzwDecoderState
+{
+    LzwDecoderState();
+    LzwDecoderState(const LzwDecoderState &) = delete;
+    LzwDecoderState &operator=(const LzwDecoderState &) = delete;
+    static LzwDecoderState &threadState();
+
+    char* s[4096];                              // ptrs in strings for each possible code
+    uint16_t sLen[4096];                        // code string length
+    std::unique_ptr<char[]> strings;            // string storage
+
+    uint16_t prefix[4096];                      // code of the string less its last byte
+    uint8_t suffix[4096];                       // last byte of the string
+    uint8_t first[4096];                        // first byte of the string
+    uint16_t length[4096];                      // string length
+    uint32_t offset[4096];                      // where the string starts in the output
+
+    std::vector<char> rows;                     // row window of decompressLZWRows
+};
+
+// why decompressLZW stopped
+enum LzwStatus
+{
+    LZW_OK,                                     // EOF_CODE
+    LZW_INPUT_END,                              // strip ran out of codes before EOF_CODE
+    LZW_OUTPUT_LIMIT,                           // reached LzwParams::outLimit
+    LZW_OUTPUT_FULL,                            // output filled, the last string cut
+    LZW_BAD_CODE                                // code past the table (checked only)
+};
+
+struct LzwResult
+{
+    LzwStatus status;
+    size_t bytesWritten;
+};
+
+/*
+    What a decode met, for profiling and for picking a path by content: a high ratio and
+    long strings mean flat runs, a low ratio and strings of one or two bytes mean noise.
+    decompressLZW adds to the counts, so one LzwStats can sum a whole image.  tableFulls
+    counts the times the table reached 4096 codes without a CLEAR_CODE; TIFF encoders
+    clear one code before that, so it marks an unusual writer or a damaged strip.
+*/
+struct LzwStats
+{
+    size_t strips = 0;
+    size_t codes = 0;                           // all codes read, CLEAR_CODE and EOF_CODE too
+    size_t clears = 0;                          // CLEAR_CODEs
+    size_t tableFulls = 0;                      // table full with no CLEAR_CODE
+    size_t kwkwk = 0;                           // code == nextCode, string + its first byte
+    size_t lengths[12] = {};                    // strings of length [2^i, 2^(i+1))
+    size_t inputBytes = 0;                      // strip bytes
+    size_t outputBytes = 0;                     // decoded bytes
+
+    size_t strings() const
+    {
+        size_t n = 0;
+        for (size_t count : lengths) n += count;
+        return n;
+    }
+    double meanLength() const { return strings() ? (double)outputBytes / strings() : 0; }
+    double ratio() const { return inputBytes ? (double)outputBytes / inputBytes : 0; }
+};
+
+/*
+    Decode one strip into out, which may be any memory (an image, a staging buffer, a
+    mapped file).  Nothing is written at or past out + outCapacity: each string is checked
+    before it is written, and one that would not fit is written up to the end of out and
+    decoding stops with LZW_OUTPUT_FULL, so a strip with more data than out (a corrupt
+    one, or a last strip coded padded to the full RowsPerStrip) fills it and cannot
+    overrun it.  With an outLimit decoding stops at the
+    first code that reaches it (the last string may run past it, up to the capacity), for
+    when only the top rows are wanted.  The overloads without a state use the calling
+    thread's, the vector one decodes into out.size() bytes.
+
+    Input, output and the table are always bounded: the table stops at 4096 codes on a
+    stream that never clears, and a code past the end of the table is taken as the next
+    code, so a damaged strip gives garbage pixels but never reads or writes outside the
+    table and out.  For files from outside, set LzwParams::checked: decoding then stops
+    at such a code with LZW_BAD_CODE, so the damage is reported.  Both loops compare each
+    code with nextCode once, the checked one is a template argument only for what it
+    does with a bad one.
+
+    The overload with an LzwStats counts as it decodes.  Counting is a template argument
+    too: the other overloads run loops with no counting in them at all.
+*/
+LzwResult decompressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                        const LzwParams &p, LzwDecoderState &state);
+LzwResult decompressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                        const LzwParams &p, LzwDecoderState &state, LzwStats &stats);
+LzwResult decompressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                        const LzwParams &p);
+LzwResult decompressLZW(const std::vector<char> &in, std::vector<char> &out, const LzwParams &p);
+
+/*
+    Push style decode for callers that want each row once (histograms, thumbnails,
+    hashing): the strip is decoded into a window of one row plus the longest string
+    rather than a buffer for the whole strip, and every row goes to sink as soon as its
+    last byte is decoded and the predictor has run on it, while it is still in L1.
+    Memory is O(row) whatever the strip size.  The window belongs to the state, so it is
+    allocated once per thread.
+
+    sink gets the row, bytesPerRow bytes, and its index from the top of the strip.  The
+    pointer is only good for the call: the window is reused for the next row.  Returning
+    false stops decoding with LZW_OUTPUT_LIMIT.  A strip that ends inside a row (status
+    LZW_OK or LZW_INPUT_END) delivers that row too, the rest of it zeros.  bytesWritten
+    counts the decoded bytes, part row included.
+
+    Output is the same as decompressLZW's with the same params, except that the
+    copy table engine is always used: the prefix chain reads earlier strings back from
+    the output, which is gone once its row has been handed on.  Stats are not counted.
+    bytesPerRow must be set, without it nothing is decoded (LZW_OUTPUT_FULL).
+*/
+typedef std::function<bool(const char* row, uint32_t index)> LzwRowSink;
+
+LzwResult decompressLZWRows(const char* in, size_t inLength, const LzwParams &p,
+                            LzwDecoderState &state, const LzwRowSink &sink);
+LzwResult decompressLZWRows(const char* in, size_t inLength, const LzwParams &p,
+                            const LzwRowSink &sink);
+
+// codes in a strip up to and including EOF_CODE, read with the decoders' bit reader and
+// code size rules but nothing decoded; the bit extraction alone, for profiling
+size_t countLzwCodes(const char* in, size_t inLength);
+
+#endif // LZW_H
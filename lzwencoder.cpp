@@ -0,0 +1,195 @@
+#include "lzwencoder.h"
+#include "predictor.h"
+
+#include <algorithm>
+#include <cstring>
+
+LzwEncoderState::LzwEncoderState()
+{
+    std::memset(table, 0, sizeof(table));
+}
+
+LzwEncoderState &LzwEncoderState::threadState()
+{
+    static thread_local std::unique_ptr<LzwEncoderState> state;
+    if (!state) state.reset(new LzwEncoderState);
+    return *state;
+}
+
+namespace {
+
+// codes added between two CLEAR_CODEs, 258 up to the clear at 4094
+const size_t codesPerTable = 4094 - 258;
+
+inline uint32_t swap16(uint32_t v)
+{
+    return (v >> 8 | v << 8) & 0xFFFF;
+}
+
+// out[i] = in[i] - in[i - stride], the first pixel as is
+void differenceRow8(char* out, const char* in, size_t bytes, int stride)
+{
+    std::memcpy(out, in, std::min(bytes, (size_t)stride));
+    for (size_t i = stride; i < bytes; ++i) out[i] = (char)(in[i] - in[i - stride]);
+}
+
+// the same on host order 16 bit samples, stride in samples, written in file order
+void differenceRow16(char* out, const char* in, size_t bytes, int stride, bool predict,
+                     bool swap)
+{
+    const size_t n = bytes / 2;
+    for (size_t i = 0; i != n; ++i) {
+        uint16_t v, before = 0;
+        std::memcpy(&v, in + 2 * i, 2);
+        if (predict && i >= (size_t)stride) std::memcpy(&before, in + 2 * (i - stride), 2);
+        uint32_t d = (uint16_t)(v - before);
+        if (swap) d = swap16(d);
+        const uint16_t w = (uint16_t)d;
+        std::memcpy(out + 2 * i, &w, 2);
+    }
+}
+
+/*
+    The coder proper.  Bits gather at the low end of acc and go out 32 at a time, so
+    the stores are whole words and every byte of out is written once.  prefix is the
+    code of the string matched so far; it carries across calls, so a strip can be fed
+    one row at a time.
+*/
+struct Encoder
+{
+    uint32_t* table;
+    uint8_t* out;
+    uint64_t acc = 0;
+    uint32_t accBits = 0;
+    uint32_t codeBits = 9;
+    uint32_t nextCode = 258;
+    uint32_t prefix = 0;
+    bool started = false;                       // prefix holds a string
+
+    Encoder(uint32_t* table, char* out) : table(table), out((uint8_t*)out) {}
+
+    void emit(uint32_t code)
+    {
+        acc = acc << codeBits | code;
+        accBits += codeBits;
+        if (accBits >= 32) {
+            accBits -= 32;
+            const uint32_t w = (uint32_t)(acc >> accBits);
+            out[0] = (uint8_t)(w >> 24);
+            out[1] = (uint8_t)(w >> 16);
+            out[2] = (uint8_t)(w >> 8);
+            out[3] = (uint8_t)w;
+            out += 4;
+        }
+    }
+
+    void clear()
+    {
+        emit(CLEAR_CODE);
+        std::memset(table, 0, LzwEncoderState::hashSize * sizeof(uint32_t));
+        nextCode = 258;
+        codeBits = 9;
+    }
+
+    // the decoder reads one code behind, so the width grows when nextCode reaches
+    // 512, not 511, and the table is cleared one code short of 4095
+    void added()
+    {
+        ++nextCode;
+        if (nextCode == 512 || nextCode == 1024 || nextCode == 2048) ++codeBits;
+        else if (nextCode == 4094) clear();
+    }
+
+    void encode(const uint8_t* data, size_t n)
+    {
+        if (!n) return;
+        size_t i = 0;
+        if (!started) {
+            prefix = data[i++];
+            started = true;
+        }
+        const uint32_t mask = LzwEncoderState::hashSize - 1;
+        for (; i != n; ++i) {
+            const uint32_t key = prefix << 8 | data[i];
+            uint32_t h = (key * 2654435761u) >> 19;
+            uint32_t e;
+            while ((e = table[h]) != 0 && e >> 12 != key) h = (h + 1) & mask;
+            if (e) {
+                prefix = e & 0xFFF;
+                continue;
+            }
+            emit(prefix);
+            table[h] = key << 12 | nextCode;
+            added();
+            prefix = data[i];
+        }
+    }
+
+    // the last string, EOF_CODE and the bits left over; returns the end of the strip
+    char* finish()
+    {
+        if (started) {
+            emit(prefix);
+            ++nextCode;                         // the decoder adds one more
+            if (nextCode == 512 || nextCode == 1024 || nextCode == 2048) ++codeBits;
+        }
+        emit(EOF_CODE);
+        while (accBits >= 8) {
+            accBits -= 8;
+            *out++ = (uint8_t)(acc >> accBits);
+        }
+        if (accBits) *out++ = (uint8_t)(acc << (8 - accBits));
+        return (char*)out;
+    }
+};
+
+} // namespace
+
+size_t lzwCompressBound(size_t inLength)
+{
+    const size_t codes = inLength + inLength / codesPerTable + 2;
+    return (codes * 12 + 7) / 8;
+}
+
+size_t compressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                   const LzwParams &p, LzwEncoderState &state)
+{
+    if (outCapacity < lzwCompressBound(inLength) || p.floatingPoint) return 0;
+    const bool wide = p.bitsPerSample == 16;
+    const bool swap = wide && p.bigEndian != hostBigEndian();
+    const bool rows = p.predictor || swap;
+    if (rows) {
+        if (p.predictor && p.bitsPerSample != 8 && !wide) return 0;
+        if (p.bytesPerRow <= 0 || inLength % p.bytesPerRow) return 0;
+        if (wide && (p.bytesPerRow % 2 || p.stride % 2)) return 0;
+    }
+
+    Encoder e(state.table, out);
+    e.clear();
+    if (!rows) e.encode((const uint8_t*)in, inLength);
+    else {
+        const size_t bytesPerRow = (size_t)p.bytesPerRow;
+        if (state.row.size() < bytesPerRow) state.row.resize(bytesPerRow);
+        char* row = state.row.data();
+        for (size_t r = 0; r != inLength; r += bytesPerRow) {
+            if (wide) differenceRow16(row, in + r, bytesPerRow, p.stride / 2, p.predictor, swap);
+            else differenceRow8(row, in + r, bytesPerRow, p.stride);
+            e.encode((const uint8_t*)row, bytesPerRow);
+        }
+    }
+    return e.finish() - out;
+}
+
+size_t compressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                   const LzwParams &p)
+{
+    return compressLZW(in, inLength, out, outCapacity, p, LzwEncoderState::threadState());
+}
+
+bool compressLZW(const char* in, size_t inLength, std::vector<char> &out, const LzwParams &p)
+{
+    out.resize(lzwCompressBound(inLength));
+    const size_t n = compressLZW(in, inLength, out.data(), out.size(), p);
+    out.resize(n);
+    return n != 0;
+}
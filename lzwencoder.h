@@ -0,0 +1,58 @@
+#ifndef LZWENCODER_H
+#define LZWENCODER_H
+
+/*
+    Compress a strip the way decompressLZW reads it back: codes MSB first, 9 to 12 bits,
+    the code width grows one code early and the table is cleared (CLEAR_CODE) when it
+    is one short of full, CLEAR_CODE first and EOF_CODE last.
+
+    The string table is an open addressing hash keyed on (prefix code, byte).  Key and
+    code share one 32 bit entry, key << 12 | code, so a probe is a single load and the
+    whole table is 32 KB, the size of L1.  It is twice the codes in size, so a lookup
+    rarely probes more than once or twice.
+
+    The input is what decompressLZW gives back for the same LzwParams: rows of
+    bytesPerRow, 16 bit samples in host byte order.  With the predictor set each row is
+    differenced (Predictor = 2) into a scratch row before it is coded, so the input is
+    never written.  16 bit samples are put in the file's byte order on the way.
+*/
+
+#include "lzw.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Hash table and scratch row for compressLZW.  Build one per thread and reuse it,
+// threadState() returns one owned by the calling thread.
+struct LzwEncoderState
+{
+    LzwEncoderState();
+    LzwEncoderState(const LzwEncoderState &) = delete;
+    LzwEncoderState &operator=(const LzwEncoderState &) = delete;
+    static LzwEncoderState &threadState();
+
+    static const uint32_t hashSize = 8192;
+    uint32_t table[hashSize];                   // key << 12 | code, 0 = empty
+    std::vector<char> row;                      // differenced row
+};
+
+// the largest strip compressLZW can make from inLength bytes: every byte its own
+// 12 bit code plus a CLEAR_CODE every 3836 codes
+size_t lzwCompressBound(size_t inLength);
+
+/*
+    Compress inLength bytes (whole rows when the predictor is set) into out and return
+    the strip length.  out must hold lzwCompressBound(inLength) bytes.  0 means nothing
+    was written: out is smaller than that, the params ask for the floating point
+    predictor, the horizontal predictor on samples that are not 8 or 16 bit, or rows
+    that do not divide inLength.  The vector overload sizes out to the strip.
+*/
+size_t compressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                   const LzwParams &p, LzwEncoderState &state);
+size_t compressLZW(const char* in, size_t inLength, char* out, size_t outCapacity,
+                   const LzwParams &p);
+bool compressLZW(const char* in, size_t inLength, std::vector<char> &out, const LzwParams &p);
+
+#endif // LZWENCODER_H
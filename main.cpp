@@ -1,135 +1,37 @@
 /*
-    Decompress a tiff strip that has LZW Prediction compression. Tiff files are composed
+    Decompress a tiff image that has LZW Prediction compression. Tiff files are composed
     of strips, which have a defined number of rows (lines of pixels in the image). The
-    tiff image may have 1 to many strips. The strip is an array of bytes RGBRGB... In
-    this case we want to decode the first strip in the tiff file.
-
-    The compressed file is lzw.tif.  The offset and length of the first strip has been
-    predefined.  The same image has been saved as an uncompressed tiff called base.tif.
-    We can use this to check our decompression of lzw is correct.
-
-    The algorithm to decompress LZW (from TIFF6 Specification):
-
-    while ((Code = GetNextCode()) != EoiCode) {
-        if (Code == ClearCode) {
-            InitializeTable();
-            Code = GetNextCode();
-            if (Code == EoiCode)
-                break;
-            WriteString(StringFromCode(Code));
-            OldCode = Code;
-        } // end of ClearCode case
-        else {
-            if (IsInTable(Code)) {
-                WriteString(StringFromCode(Code));
-                AddStringToTable(StringFromCode(OldCode)+FirstChar(StringFromCode(Code)));
-                OldCode = Code;
-            } else {
-                OutString = StringFromCode(OldCode) + FirstChar(StringFromCode(OldCode));
-                WriteString(OutString);
-                AddStringToTable(OutString);
-                OldCode = Code;
-            }
-        } // end of not-ClearCode case
-    } // end of while loop
-
-    The prediction variant uses the difference between row pixels for the code value.
-
-    This is my third version.  The first version input a stream, overloaded the >>
-    operator, and used string and QByteArray functions.  It took 130 ms to decompress
-    the strip.  The second version ditched the >> overloading and the stream, working
-    directly with the QByteArrays, and took 80ms.  The third run (this one) elimimates
-    all string and QByteArray functions, using byte arrays and pointers, running in
-    3.3 ms.
-
-    Things that have not helped:
-
-    - do basic lzw decompression and make a second pass to do prediction increment.
-    - use pointer instead or array indice to output char string for code.
-
-    Alternatives to std::memcpy
-
-        // option for byte-by-byte
-
-        char* pDst = s[nextCode];
-        char* pSrc = (char*)&ps;
-        for (size_t i = 0; i != psLen; ++i) pDst[i] = pSrc[i];
-
-        // or
-
-        char* pDst = s[nextCode];
-        char* pSrc = (char*)&ps;
-        size_t len = psLen;
-        while (len--)
-        {
-            *pDst++ = *pSrc++;
-        }
-
-        // option for 4 bytes at a time
-
-        uint32_t* pDst = (uint32_t*)s[nextCode];
-        uint32_t* pSrc = (uint32_t*)&ps;
-        size_t len = psLen / 4 + 1;
-        for (size_t i = 0; i != len; ++i) pDst[i] = pSrc[i];
-
-
+    tiff image may have 1 to many strips. The strip is an array of bytes RGBRGB... Each
+    strip is decoded by decompressLZW (lzw.cpp) into its place in the image (decoder.cpp).
+
+    Run as main lzw.tif base.tif.  The compressed file, lzw.tif, is memory mapped
+    (mappedfile.h).  The strip offsets and lengths, the row geometry and the predictor
+    are read from the tiff IFD (see tiff.h).  The same image has been saved as an
+    uncompressed tiff, base.tif.  We use it to check our decompression of lzw is
+    correct, byte for byte.  Damaged copies of the first strip check that a checked
+    decode reports a bad code and an unchecked one stays inside its output, and the two
+    code table engines must count the same LzwStats.  The exit code is 1 when a decode
+    does not match, a damaged strip is not handled or the stats differ.
+
+    Timings are in the bench project (bench/bench.pro).
 */
 
 #include <QDebug>
 
-#include <chrono>
+#include "decoder.h"
+#include "mappedfile.h"
+#include "predictor.h"
+#include "tiff.h"
+#include "tiffwriter.h"
+
 #include <vector>
 #include <array>
-#include <iomanip>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <algorithm>
 
-const unsigned int CLEAR_CODE = 256;
-const unsigned int EOF_CODE = 257;
-const unsigned int MAXCODE = 4095;      // 12 bit max less some head room
-
-// Enter info for base and lwz tiff files
-///* D:/Pictures/_TIFF_lzw1/lzwP_8.tif LZW Predictive working
-const std::string base = "D:/Pictures/_TIFF_lzw1/base_8.tif";
-const std::string lzw  = "D:/Pictures/_TIFF_lzw1/lzwP_8.tif";
-const uint32_t lzwOffsetToFirstStrip = 34312;
-const uint32_t lzwLengthFirstStrip = 123177;
-const uint32_t lzwRowsPerStrip = 109;
-const uint32_t baseOffsetToFirstStrip = 34296;
-const uint32_t basedLengthFirstStrip = 1080000;
-const int bytesPerRow = 2400;
-const bool predictor = true;
-//*/
-
-/* D:/Pictures/_TIFF_lzw1/lzw_8.tif LZW nonPredictive working
-const std::string base = "D:/Pictures/_TIFF_lzw1/base_8.tif";
-const std::string lzw  = "D:/Pictures/_TIFF_lzw1/lzw_8.tif";
-const uint32_t lzwOffsetToFirstStrip = 17232;
-const uint32_t lzwLengthFirstStrip = 14950;
-const uint32_t lzwRowsPerStrip = 8;
-const uint32_t baseOffsetToFirstStrip = 34296;
-const uint32_t basedLengthFirstStrip = 1080000;
-const int bytesPerRow = 2400;
-const bool predictor = false;
-//*/
-
-/* D:/Pictures/_TIFF_lzw1/lzw_16.tif LZW nonPredictive working
-const std::string base = "D:/Pictures/_TIFF_lzw1/base_16.tif";
-const std::string lzw  = "D:/Pictures/_TIFF_lzw1/lzw_16.tif";
-const uint32_t lzwOffsetToFirstStrip = 17250;
-const uint32_t lzwLengthFirstStrip = 24092;
-const uint32_t lzwRowsPerStrip = 8;
-const uint32_t baseOffsetToFirstStrip = 34004;
-const uint32_t basedLengthFirstStrip = 2160000;
-const int bytesPerRow = 4800;
-const bool predictor = false;
-//*/
-
-
-std::vector<char> baseFirstStrip(basedLengthFirstStrip);
-const int bytesPerStrip = lzwRowsPerStrip * bytesPerRow;
-
 void byteArrayToHex(std::vector<char> v, int cols, unsigned long start, unsigned long end)
 {
     int n = 0;
@@ -141,331 +43,290 @@ void byteArrayToHex(std::vector<char> v, int cols, unsigned long start, unsigned
     std::cout << '\n';
 }
 
-#define LZW_STRING_SIZE 256
-#define LZW_STRINGS_SIZE 128000
-
-bool decompressLZW(std::vector<char> &inBa, std::vector<char> &outBa)
-/*
-    Works for RGB but not for RRGGBB (planarConfiguration = 2).  Requires tweak to pBuf.
-*/
+// LZW is lossless and the predictor exact, so every byte must match
+bool checkImage(const std::vector<char> &ba, const std::vector<char> &baseImage)
 {
-    bool ret = false;
-    // input and output pointers
-    char* c = inBa.data();
-    char* out = outBa.data();
-
-    char* s[4096];                                  // ptrs in strings for each possible code
-    int8_t sLen[4096];                              // code string length
-    std::memset(&sLen, 1, 256);                     // 0-255 one char strings
-
-    char strings[LZW_STRINGS_SIZE];
-    // initialize first 256 code strings
-    for (int i = 0 ; i != 256 ; i++ ) {
-        strings[i] = (char)i;
-        s[i] = &strings[i];
-    }
-    strings[256] = 0;  s[256] = &strings[256];      // Clear code
-    strings[257] = 0;  s[257] = &strings[257];      // EOF code
-    const uint32_t maxCode = 4095;                  // max for 12 bits
-    char* sEnd;                                     // ptr to current end of strings
-
-    char ps[LZW_STRING_SIZE];                       // previous string
-    size_t psLen = 0;                               // length of prevString
-    uint32_t code;                                  // key to string for code
-    uint32_t nextCode = 258;                        // used to preset string for next
-    uint32_t incoming = (uint32_t)inBa.size();      // count down input chars
-    int n = 0;                                      // output byte counter
-    uint32_t iBuf = 0;                              // incoming bit buffer
-    int32_t nBits = 0;                              // incoming bits in the buffer
-    int32_t codeBits = 9;                           // number of bits to make code (9-12)
-    uint32_t nextBump = 511;                        // when to increment code size 1st time
-    uint32_t pBuf = 0;                              // previous out bit buffer
-    uint32_t mask = (1 << codeBits) - 1;            // extract code from iBuf
-
-    uint32_t* pSrc;                                 // ptr to src for word copies
-    uint32_t* pDst;                                 // ptr to dst for word copies
-
-    // read incoming bytes into the bit buffer (iBuf) using the char pointer c
-    while (incoming) {
-//        if (n > 8995) {
-//            int xxx = 0;
-//        }
-        // GetNextCode
-        iBuf = (iBuf << 8) | (uint8_t)*c++;         // make room in bit buf for char
-        nBits += 8;
-        --incoming;
-        if (nBits < codeBits) {
-            iBuf = (iBuf << 8) | (uint8_t)*c++;     // make room in bit buf for char
-            nBits += 8;
-            --incoming;
-        }
-        code = (iBuf >> (nBits - codeBits)) & mask; // extract code from buffer
-        nBits -= codeBits;                          // update available bits to process
-
-        // rest at start and when codes = max ~+ 4094
-        if (code == CLEAR_CODE) {
-            codeBits = 9;
-            mask = (1 << codeBits) - 1;
-            nextBump = 511;
-            sEnd = s[257];
-            nextCode = 258;
-            psLen = 0;
-            continue;
-        }
-
-        // finished (should not need as incoming counts down to zero)
-        if (code == EOF_CODE) {
-            return ret;
-        }
-
-        // new code then add prevString + prevString[0]
-        // copy prevString
-        if (code == nextCode) {
-            s[code] = sEnd;
-            switch(psLen) {
-            case 1:
-                *s[code] = ps[0];
-                break;
-            case 2:
-                *s[code] = ps[0];
-                *(s[code]+1) = ps[1];
-                break;
-            case 4:
-                pDst = (uint32_t*)s[code];
-                pSrc = (uint32_t*)&ps;
-                *pDst = *pSrc;
-                break;
-            case 5:
-            case 6:
-            case 7:
-            case 8:
-                pDst = (uint32_t*)s[nextCode];
-                pSrc = (uint32_t*)&ps;
-                *pDst = *pSrc;
-                *(pDst+1) = *(pSrc+1);
-                break;
-            default:
-                std::memcpy(s[code], &ps, psLen);
-            }
-
-            // copy prevString[0]
-            *(s[code] + psLen) = ps[0];
-            sLen[code] = (int8_t)psLen + 1;
-            sEnd = s[code] + psLen + 1;
-        }
-
-        if (predictor) {
-            for (uint32_t i = 0; i != (uint32_t)sLen[code]; i++) {
-                if (n % bytesPerRow < 3) *out++ = *(s[code] + i);
-                else *out++ = *(s[code] + i) + *(out - 3);
-                ++n;
-                /*
-                // output char string for code (add from left)
-                // pBuf   00000000 11111111 22222222 33333333
-                if (n % bytesPerRow == 0) pBuf = 0;
-                char b = *(s[code] + i) + (uint8_t)(pBuf & 0xFF);
-                *out++ = b;
-                pBuf = (pBuf >> 8) | (uint32_t)((uint8_t)b << 16);
-                ++n;
-                */
-            }
-        }
-        else {
-            for (uint32_t i = 0; i != (uint32_t)sLen[code]; i++) {
-                uchar b = (uchar)*(s[code] + i);
-                *out++ = *(s[code] + i);
-                if (n == 26400) {
-                    int xxx = 0;
-                }
-                ++n;
-            }
-        }
-
-        // add string to nextCode (prevString + strings[code][0])
-        // copy prevString
-        if (psLen/* && nextCode <= MAXCODE*/) {
-            s[nextCode] = sEnd;
-            switch(psLen) {
-            case 1:
-                *s[nextCode] = ps[0];
-                break;
-            case 2:
-                *s[nextCode] = ps[0];
-                *(s[nextCode]+1) = ps[1];
-                break;
-            case 4:
-                pDst = (uint32_t*)s[nextCode];
-                pSrc = (uint32_t*)&ps;
-                *pDst = *pSrc;
-                break;
-            case 5:
-            case 6:
-            case 7:
-            case 8:
-                pDst = (uint32_t*)s[nextCode];
-                pSrc = (uint32_t*)&ps;
-                *pDst = *pSrc;
-                *(pDst+1) = *(pSrc+1);
-                break;
-            default:
-                std::memcpy(s[nextCode], &ps, psLen);
-            }
-
-            // copy strings[code][0]
-            *(s[nextCode] + psLen) = *s[code];
-
-            sLen[nextCode] = (int8_t)(psLen + 1);
-            sEnd = s[nextCode] + psLen + 1;
-            ++nextCode;
-        }
-
-        // strings[code][0] copy
-        switch(sLen[code]) {
-        case 1:
-            ps[0] = *s[code];
-            break;
-        case 2:
-            ps[0] = *s[code];
-            ps[1] = *(s[code]+1);
-            break;
-        case 4:
-            pSrc = (uint32_t*)s[code];
-            pDst = (uint32_t*)&ps;
-            *pDst = *pSrc;
-            break;
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-            pSrc = (uint32_t*)s[code];
-            pDst = (uint32_t*)&ps;
-            *pDst = *pSrc;
-            *(pDst+1) = *(pSrc+1);
-            break;
-        default:
-            memcpy(&ps, s[code], (size_t)sLen[code]);
-        }
-
-        psLen = (size_t)sLen[code];
-
-         // codeBits change
-        if (nextCode == nextBump) {
-            if (nextCode < maxCode) {
-                nextBump = (nextBump << 1) + 1;
-                ++codeBits;
-                mask = (1 << codeBits) - 1;
-            }
-            else if (nextCode == maxCode) continue;
-            else {
-                codeBits = 9;
-                mask = (1 << codeBits) - 1;
-                nextBump = 511;
-                sEnd = s[257];
-                nextCode = 258;
-                psLen = 0;
-            }
+    for (size_t i = 0; i < ba.size(); i++) {
+        if (ba[i] != baseImage[i]) {
+            std::cout << "error at " << i << "  decoded " << (ba[i] & 0xFF) << "  base "
+                      << (baseImage[i] & 0xFF) << '\n' << '\n';
+            return false;
         }
+    }
+    std::cout << "No errors." << '\n' << '\n';
+    return true;
+}
 
-//        if (n == 7000) break;
+// a decode that reports failure fails the check even when its bytes match
+bool checkDecode(bool done, const std::vector<char> &ba, const std::vector<char> &baseImage)
+{
+    if (!done) {
+        std::cout << "decode failed" << '\n' << '\n';
+        return false;
+    }
+    return checkImage(ba, baseImage);
+}
 
-    } // end while}
+bool sameStats(const LzwStats &a, const LzwStats &b)
+{
+    return a.strips == b.strips && a.codes == b.codes && a.clears == b.clears &&
+           a.tableFulls == b.tableFulls && a.kwkwk == b.kwkwk &&
+           std::equal(std::begin(a.lengths), std::end(a.lengths), std::begin(b.lengths)) &&
+           a.inputBytes == b.inputBytes && a.outputBytes == b.outputBytes;
+}
 
-    return ret;
+// a strip of 9 bit codes, MSB first as LZW packs them
+std::vector<char> nineBitCodes(std::initializer_list<uint32_t> codes)
+{
+    std::vector<char> strip((codes.size() * 9 + 7) / 8);
+    size_t bit = 0;
+    for (uint32_t code : codes) {
+        for (int b = 8; b >= 0; --b, ++bit)
+            if (code >> b & 1) strip[bit / 8] |= (char)(0x80 >> bit % 8);
+    }
+    return strip;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-//    std::ifstream f1("D:/Pictures/_TIFF_lzw1/lzw.tif", std::ios::in | std::ios::binary | std::ios::ate);
-    std::ifstream f1(lzw, std::ios::in | std::ios::binary | std::ios::ate);
-    std::vector<char> lzwFirstStrip(lzwLengthFirstStrip);
-    f1.seekg(lzwOffsetToFirstStrip);
-    f1.read(lzwFirstStrip.data(), lzwFirstStrip.size());
-    f1.close();
+    // the LZW tiff and the same image saved uncompressed
+    if (argc < 3) {
+        std::cout << "usage: " << argv[0] << " lzw.tif base.tif" << '\n';
+        return 1;
+    }
+    const std::string lzwPath = argv[1];
+    const std::string basePath = argv[2];
+
+    // map the file, the IFD, strip table and strips are read in place
+    MappedFile lzwFile;
+    TiffInfo info;
+    if (!lzwFile.open(lzwPath) || !parseTiff(lzwFile.data(), lzwFile.size(), info) ||
+        info.compression != COMPRESSION_LZW) {
+        std::cout << lzwPath << " is not an LZW compressed tiff." << '\n';
+        return 1;
+    }
+    const bool horizontal8or16 = info.predictor == PREDICTOR_HORIZONTAL &&
+                                 (info.bitsPerSample == 8 || info.bitsPerSample == 16);
+    const bool floatingPoint = info.predictor == PREDICTOR_FLOATINGPOINT &&
+                               (info.bitsPerSample == 16 || info.bitsPerSample == 32 ||
+                                info.bitsPerSample == 64);
+    if (info.predictor != PREDICTOR_NONE && !horizontal8or16 && !floatingPoint) {
+        std::cout << "Only 8/16 bit or floating point prediction is supported." << '\n';
+        return 1;
+    }
+    std::vector<uint32_t> stripOffsets(info.stripCount);
+    std::vector<uint32_t> stripByteCounts(info.stripCount);
+    readStripTable(lzwFile.data(), lzwFile.size(), info, stripOffsets.data(),
+                   stripByteCounts.data());
+
+    const size_t imageBytes = info.imageBytes();
 
     // load the "answer" from the same image, saved as an uncompressed tif.  We will
     // use this to confirm our decompression of lzw.tiff is correct
-//    std::ifstream f2("D:/Pictures/_TIFF_lzw1/base.tif", std::ios::in | std::ios::binary | std::ios::ate);
-    std::ifstream f2(base, std::ios::in | std::ios::binary | std::ios::ate);
-    f2.seekg(baseOffsetToFirstStrip);
-    f2.read(baseFirstStrip.data(), baseFirstStrip.size());
+    std::ifstream f2(basePath, std::ios::in | std::ios::binary);
+    TiffInfo baseInfo;
+    std::vector<char> baseImage(imageBytes);
+    bool baseLoaded = false;
+    if (parseTiff(f2, baseInfo) && baseInfo.compression == COMPRESSION_NONE) {
+        uint32_t baseOffsetToFirstStrip;
+        uint32_t baseLengthFirstStrip;
+        if (baseInfo.stripCount == 1 &&
+            readStripTable(f2, baseInfo, &baseOffsetToFirstStrip, &baseLengthFirstStrip)) {
+            f2.seekg(baseOffsetToFirstStrip);
+            f2.read(baseImage.data(), baseImage.size());
+            baseLoaded = (size_t)f2.gcount() == baseImage.size();
+        }
+        // 16 bit and floating point samples are decoded in host byte order
+        const size_t sampleBytes = baseInfo.bitsPerSample / 8;
+        const bool hostOrder = baseInfo.bitsPerSample == 16 || floatingPoint;
+        if (hostOrder && sampleBytes > 1 && baseInfo.bigEndian != hostBigEndian()) {
+            for (size_t i = 0; i + sampleBytes <= baseImage.size(); i += sampleBytes)
+                std::reverse(&baseImage[i], &baseImage[i] + sampleBytes);
+        }
+    }
     f2.close();
-
-    // Create the byte array to hold the decompressed byte stream
-    std::vector<char> ba(basedLengthFirstStrip);
-
-    std::string title = "LWZ without prediction";
-    int choice = 1;
-
-    int repeat;
-    int runs;
-    if (choice == 0) {
-        repeat = 1;
-        runs = 1;
+    if (!baseLoaded) {
+        std::cout << basePath << " is not an uncompressed single strip tiff of the image."
+                  << '\n';
+        return 1;
     }
-    else {
-        repeat = 5;
-        runs = 10000;
+
+    // Create the byte array to hold the decompressed image
+    std::vector<char> ba(imageBytes);
+
+    std::string title = info.predictor != PREDICTOR_NONE ? "LZW with prediction"
+                                                               : "LZW without prediction";
+    std::cout << title << "   " << info.width << " x " << info.height
+              << (info.tiled ? "   tiles: " : "   strips: ") << info.stripCount << '\n';
+
+    // decodeImage with each code table layout and predictor stage, timings are in bench/
+    struct Variant
+    {
+        std::string name;
+        LzwEngine engine;
+        LzwPredictorMode predictorMode;
+        bool checked;
+    };
+    const Variant variants[] = {
+        {"copyFused", LZW_COPY_TABLE, LZW_PREDICT_FUSED, false},
+        {"copyChecked", LZW_COPY_TABLE, LZW_PREDICT_FUSED, true},
+        {"copyRows", LZW_COPY_TABLE, LZW_PREDICT_ROWS, false},
+        {"chainFused", LZW_PREFIX_CHAIN, LZW_PREDICT_FUSED, false},
+        {"chainChecked", LZW_PREFIX_CHAIN, LZW_PREDICT_FUSED, true},
+        {"chainRows", LZW_PREFIX_CHAIN, LZW_PREDICT_ROWS, false},
+    };
+    bool ok = true;
+    for (const Variant &v : variants) {
+        if (info.predictor == PREDICTOR_NONE && v.predictorMode == LZW_PREDICT_ROWS)
+            continue;
+        DecodeOptions options;
+        options.interleave = true;                  // base.tif is chunky
+        options.adviseInput = true;
+        options.engine = v.engine;
+        options.predictorMode = v.predictorMode;
+        options.checked = v.checked;
+        std::fill(ba.begin(), ba.end(), 0);
+        const bool done = decodeImage(lzwFile.data(), lzwFile.size(), info,
+                                      stripOffsets.data(), stripByteCounts.data(), ba.data(),
+                                      options);
+        std::cout << v.name << ": ";
+        ok &= checkDecode(done, ba, baseImage);
     }
-    //*/
-    double ms;
-    double msSum = 0;
-    double mp;
-    int pixels;
-    double mpPerSec;
-    bool isErr;
-    std::chrono::time_point<std::chrono::system_clock> start, end;
 
-    // decompressLZW
-    std::cout << title << '\n';
-    for (int j = 0; j < repeat; ++j) {
-        start = std::chrono::system_clock::now();
-        for (int i = 0; i < runs; ++i) {
-            decompressLZW(lzwFirstStrip, ba);  //  3.2 - 3.8 ms per run on Rory macbookpro
+    // decodeImageParallel
+    ThreadPool pool;
+    DecodeOptions chunky;
+    chunky.interleave = true;
+    chunky.adviseInput = true;
+    std::fill(ba.begin(), ba.end(), 0);
+    const bool parallelDone = decodeImageParallel(lzwFile.data(), lzwFile.size(), info,
+                                                  stripOffsets.data(), stripByteCounts.data(),
+                                                  ba.data(), pool, chunky);
+    std::cout << "decodeParallel, workers " << pool.size() << ": ";
+    ok &= checkDecode(parallelDone, ba, baseImage);
+
+    // write the decoded image as a new LZW tiff, then decode that
+    TiffInfo outInfo = info;
+    outInfo.tiled = false;
+    outInfo.planarConfiguration = PLANARCONFIG_CONTIG;  // ba is chunky
+    outInfo.rowsPerStrip = info.tiled ? info.tileLength : info.rowsPerStrip;
+    std::ostringstream written;
+    std::cout << "writeTiffParallel: ";
+    if (writeTiffParallel(written, outInfo, ba.data(), pool)) {
+        const std::string file = written.str();
+        TiffInfo backInfo;
+        bool done = parseTiff(file.data(), file.size(), backInfo);
+        std::vector<uint32_t> backOffsets(backInfo.stripCount);
+        std::vector<uint32_t> backCounts(backInfo.stripCount);
+        done = done && readStripTable(file.data(), file.size(), backInfo, backOffsets.data(),
+                                      backCounts.data());
+        std::vector<char> back(imageBytes);
+        done = done && decodeImage(file.data(), file.size(), backInfo, backOffsets.data(),
+                                   backCounts.data(), back.data());
+        ok &= checkDecode(done, back, baseImage);
+
+        // and once more a row at a time, each row copied to its place as it arrives
+        const size_t rowBytes = backInfo.bytesPerRow();
+        std::fill(back.begin(), back.end(), 0);
+        done = decodeImageRows(file.data(), file.size(), backInfo, backOffsets.data(),
+                        backCounts.data(), [&](const char* row, uint32_t y, uint32_t) {
+            std::memcpy(&back[y * rowBytes], row, rowBytes);
+            return true;
+        });
+        std::cout << "decodeImageRows: ";
+        ok &= checkDecode(done, back, baseImage);
+    }
+    else std::cout << "not written (floating point predictor or bit depth)" << '\n';
+
+    // damaged strips.  The crafted one is CLEAR_CODE then 300, a 9 bit code past the
+    // empty table: checked must stop with LZW_BAD_CODE, unchecked must not.  The first
+    // strip with bytes flipped may decode to anything but nothing may be written past
+    // the strip, out has a guard band after it.
+    std::cout << "corrupt strips: ";
+    const char crafted[] = {(char)0x80, (char)0x4B, (char)0x00};
+    const size_t stripCapacity = (size_t)lzwParams(info).bytesPerRow *
+                                 (info.tiled ? info.tileLength
+                                             : std::min(info.rowsPerStrip, info.height));
+    const size_t guard = 4096;
+    std::vector<char> out(stripCapacity + guard);
+    bool corruptOk = true;
+    auto decodeGuarded = [&](const char* in, size_t inLength, const LzwParams &p) {
+        std::fill(out.begin(), out.end(), (char)0x5A);
+        const LzwResult r = decompressLZW(in, inLength, out.data(), stripCapacity, p);
+        corruptOk &= std::all_of(out.begin() + stripCapacity, out.end(),
+                                 [](char c) { return c == (char)0x5A; });
+        return r.status;
+    };
+    const LzwEngine engines[] = {LZW_COPY_TABLE, LZW_PREFIX_CHAIN};
+    for (LzwEngine engine : engines) {
+        LzwParams p = lzwParams(info);
+        p.engine = engine;
+        p.checked = true;
+        corruptOk &= decodeGuarded(crafted, sizeof crafted, p) == LZW_BAD_CODE;
+        p.checked = false;
+        corruptOk &= decodeGuarded(crafted, sizeof crafted, p) != LZW_BAD_CODE;
+
+        if (!info.stripCount || !stripByteCounts[0] ||
+            (uint64_t)stripOffsets[0] + stripByteCounts[0] > lzwFile.size())
+            continue;
+        const char* strip = lzwFile.data() + stripOffsets[0];
+        for (uint32_t i = 0; i != 64; ++i) {
+            std::vector<char> damaged(strip, strip + stripByteCounts[0]);
+            for (uint32_t k = 0; k != 4; ++k)
+                damaged[(i * 7919u + k * 104729u) % damaged.size()] ^= (char)(1 + i * 37 + k);
+            p.checked = i % 2 != 0;
+            decodeGuarded(damaged.data(), damaged.size(), p);
         }
-        end = std::chrono::system_clock::now();
-
-        ms = (double)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        msSum += ms;
-        ms /= (1000 * runs);
-        pixels = 261600 / 3;
-        mp = (double)pixels / 1000000;
-        mpPerSec = mp / ms * 1000;                        // megapixels / sec
-
-        std::cout
-             << "decompressLZW " << std::setw(6) << j + 1
-             << "   runs: " << std::setw(6) << runs
-             << std::fixed << std::showpoint << std::setprecision(2)
-             << "   ms/run: " << ms
-             << "   mp/sec: " << mpPerSec
-             << '\n';
     }
-
-    double msAve = msSum / (repeat * runs * 1000);
-    std::cout << std::setw(46) << "Average: " << msAve << '\n';
-
-    // check result
-    isErr = false;
-    for (uint32_t i = 0; i < bytesPerStrip; i++) {
-//        if (ba[i] != baseFirstStrip[i]) {
-        int a = ba[i] & 0xFF;
-        int b = baseFirstStrip[i] & 0xFF;
-        int diff = std::abs(a - b);
-        if (diff > 2) {
-            std::cout << "error at " << i << "  diff = " << diff << '\n';
-            isErr = true;
-            break;
+    std::cout << (corruptOk ? "No errors." : "bad code not reported or output overrun")
+              << '\n' << '\n';
+    ok &= corruptOk;
+
+    // both engines must count the same LzwStats for a strip: every strip whole, cut
+    // short by an output a third of its size (LZW_OUTPUT_FULL), and the first strip
+    // with bytes flipped, where unchecked bad codes are taken as the next code.  Two
+    // crafted strips pin KwKwK down: "A" then 258 ("AA") is one, counted only when it
+    // is written, not when the output fills inside it, and a bad code taken as 258
+    // is none.
+    std::cout << "engine stats: ";
+    bool statsOk = true;
+    auto compareEngines = [&](const char* in, size_t inLength, size_t capacity) {
+        LzwStats stats[2];
+        for (int e = 0; e != 2; ++e) {
+            LzwParams p = lzwParams(info);
+            p.engine = engines[e];
+            decompressLZW(in, inLength, out.data(), capacity, p,
+                          LzwDecoderState::threadState(), stats[e]);
+        }
+        statsOk &= sameStats(stats[0], stats[1]);
+        return stats[0].kwkwk;
+    };
+    const std::vector<char> kwkwk = nineBitCodes({CLEAR_CODE, 'A', 258, EOF_CODE});
+    const std::vector<char> clamped = nineBitCodes({CLEAR_CODE, 'A', 300, EOF_CODE});
+    statsOk &= compareEngines(kwkwk.data(), kwkwk.size(), stripCapacity) == 1;
+    statsOk &= compareEngines(kwkwk.data(), kwkwk.size(), 2) == 0;
+    statsOk &= compareEngines(clamped.data(), clamped.size(), stripCapacity) == 0;
+    for (uint32_t s = 0; s != info.stripCount; ++s) {
+        if ((uint64_t)stripOffsets[s] + stripByteCounts[s] > lzwFile.size()) continue;
+        const char* strip = lzwFile.data() + stripOffsets[s];
+        compareEngines(strip, stripByteCounts[s], stripCapacity);
+        compareEngines(strip, stripByteCounts[s], stripCapacity / 3);
+        if (s || !stripByteCounts[s]) continue;
+        for (uint32_t i = 0; i != 64; ++i) {
+            std::vector<char> damaged(strip, strip + stripByteCounts[s]);
+            for (uint32_t k = 0; k != 4; ++k)
+                damaged[(i * 7919u + k * 104729u) % damaged.size()] ^= (char)(1 + i * 37 + k);
+            compareEngines(damaged.data(), damaged.size(), stripCapacity);
         }
     }
-    if (!isErr) std::cout << "No errors." << '\n' << '\n';
+    std::cout << (statsOk ? "No errors." : "engines count different stats") << '\n' << '\n';
+    ok &= statsOk;
 
     // helper report
-    std::cout << "decompressLZW:" << '\n';
+    std::cout << "decodeImage:" << '\n';
     byteArrayToHex(ba, 25, 0, 50);
     std::cout << "base:" << '\n';
-    byteArrayToHex(baseFirstStrip, 25, 0, 50);
+    byteArrayToHex(baseImage, 25, 0, 50);
 
-    // pause if running executable in terminal
-    std::cout << "Paused, press ENTER to continue." << std::endl;
-    std::cin.ignore();
-    exit(0);
+    return ok ? 0 : 1;
 }
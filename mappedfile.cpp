@@ -0,0 +1,124 @@
+#include "mappedfile.h"
+
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+    file = f;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        close();
+        return false;
+    }
+    bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!bytes) {
+        close();
+        return false;
+    }
+    length = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+    bytes = nullptr;
+    length = 0;
+    mapping = nullptr;
+    file = nullptr;
+}
+
+void adviseWillNeed(const char* p, size_t n)
+{
+#if _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range = {(void*)p, n};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    (void)p;
+    (void)n;
+#endif
+}
+
+void adviseSequential(const char*, size_t)
+{
+    // FILE_FLAG_SEQUENTIAL_SCAN on open is the only such hint
+}
+
+#else
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);                                // the mapping keeps the file open
+    if (p == MAP_FAILED) return false;
+    bytes = (const char*)p;
+    length = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes) munmap((void*)bytes, length);
+    bytes = nullptr;
+    length = 0;
+}
+
+namespace {
+
+void advise(const char* p, size_t n, int advice)
+{
+    if (!n) return;
+    static const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (uintptr_t)p & ~(page - 1);
+    const uintptr_t end = ((uintptr_t)p + n + page - 1) & ~(page - 1);
+    madvise((void*)start, end - start, advice);
+}
+
+} // namespace
+
+void adviseWillNeed(const char* p, size_t n)
+{
+    advise(p, n, MADV_WILLNEED);
+}
+
+void adviseSequential(const char* p, size_t n)
+{
+    advise(p, n, MADV_SEQUENTIAL);
+}
+
+#endif
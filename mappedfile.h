@@ -0,0 +1,44 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+/*
+    Read only mapping of a whole file (mmap, or MapViewOfFile on Windows).  The decoder
+    reads the compressed strips straight out of the mapping, so there is no copy of the
+    file in the process and a file decoded again is served from the page cache.
+
+    The advise functions pass access hints for a range of a mapping to the kernel,
+    rounded out to whole pages.  willNeed starts reading the pages in the background,
+    sequential asks for aggressive read ahead.  They do nothing where the platform has
+    no such hint, and any range of memory may be passed.
+*/
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool open(const std::string &path);
+    void close();
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    void* file = nullptr;                       // HANDLEs
+    void* mapping = nullptr;
+#endif
+};
+
+void adviseWillNeed(const char* p, size_t n);
+void adviseSequential(const char* p, size_t n);
+
+#endif // MAPPEDFILE_H
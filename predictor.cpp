@@ -0,0 +1,390 @@
+#include "predictor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PREDICTOR_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// per function instruction sets, MSVC compiles intrinsics without them
+#if defined(PREDICTOR_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+typedef void (*RowKernel)(uint8_t* row, size_t n);
+
+template <int S>
+void undoRowScalar(uint8_t* row, size_t n)
+{
+    if (n > S) predictRun8<S>((char*)row + S, (const char*)row + S, n - S);
+}
+
+/*
+    Samples of W bytes from byte i to the end of the row, S samples per pixel.  Swap
+    turns 16 bit samples from the file's byte order into the host's as they are read;
+    the sums are always taken in host order.  This is the scalar 16 bit kernel and the
+    tail of the vector ones.
+*/
+template <int W, int S, bool Swap>
+void undoRowTail(uint8_t* row, size_t i, size_t n)
+{
+    typedef typename std::conditional<W == 1, uint8_t, uint16_t>::type T;
+    for (; i + W <= n; i += W) {
+        T v;
+        std::memcpy(&v, row + i, W);
+        if (Swap) v = (T)(v << 8 | v >> 8);
+        if (i >= S * W) {
+            T u;
+            std::memcpy(&u, row + i - S * W, W);
+            v = (T)(v + u);
+        }
+        std::memcpy(row + i, &v, W);
+    }
+}
+
+template <int S, bool Swap>
+void undoRow16Scalar(uint8_t* row, size_t n)
+{
+    undoRowTail<2, S, Swap>(row, 0, n);
+}
+
+typedef void (*Deshuffle)(uint8_t* dst, const uint8_t* src, size_t count);
+
+/*
+    Floating point rows hold byte planes, the most significant byte of every sample
+    first, then the next byte of every sample, and so on.  Put count samples of W bytes
+    back together in host order.
+*/
+template <int W>
+void deshuffleScalar(uint8_t* dst, const uint8_t* src, size_t count)
+{
+    const bool big = hostBigEndian();
+    for (int b = 0; b != W; ++b) {
+        const uint8_t* plane = src + b * count;
+        uint8_t* d = dst + (big ? b : W - 1 - b);
+        for (size_t i = 0; i != count; ++i) d[i * W] = plane[i];
+    }
+}
+
+#if defined(PREDICTOR_X86)
+
+/*
+    16 samples per step: a load from each plane, then byte, word and dword unpacks
+    pairing planes least significant first, which leaves little endian samples.
+*/
+TARGET_SSE41 inline void deshuffleStep(__m128i* d, const __m128i* p, std::integral_constant<int, 2>)
+{
+    _mm_storeu_si128(d, _mm_unpacklo_epi8(p[1], p[0]));
+    _mm_storeu_si128(d + 1, _mm_unpackhi_epi8(p[1], p[0]));
+}
+
+TARGET_SSE41 inline void deshuffleStep(__m128i* d, const __m128i* p, std::integral_constant<int, 4>)
+{
+    __m128i lo32 = _mm_unpacklo_epi8(p[3], p[2]), hi32 = _mm_unpackhi_epi8(p[3], p[2]);
+    __m128i lo10 = _mm_unpacklo_epi8(p[1], p[0]), hi10 = _mm_unpackhi_epi8(p[1], p[0]);
+    _mm_storeu_si128(d, _mm_unpacklo_epi16(lo32, lo10));
+    _mm_storeu_si128(d + 1, _mm_unpackhi_epi16(lo32, lo10));
+    _mm_storeu_si128(d + 2, _mm_unpacklo_epi16(hi32, hi10));
+    _mm_storeu_si128(d + 3, _mm_unpackhi_epi16(hi32, hi10));
+}
+
+TARGET_SSE41 inline void deshuffleStep(__m128i* d, const __m128i* p, std::integral_constant<int, 8>)
+{
+    // q[0-3] low 4 bytes of samples 0-3, 4-7, 8-11, 12-15, q[4-7] the high 4 bytes
+    __m128i q[8];
+    for (int k = 0; k != 2; ++k) {
+        const __m128i* h = p + 4 - 4 * k;           // planes 7-4 then 3-0
+        __m128i loA = _mm_unpacklo_epi8(h[3], h[2]), hiA = _mm_unpackhi_epi8(h[3], h[2]);
+        __m128i loB = _mm_unpacklo_epi8(h[1], h[0]), hiB = _mm_unpackhi_epi8(h[1], h[0]);
+        q[4 * k] = _mm_unpacklo_epi16(loA, loB);
+        q[4 * k + 1] = _mm_unpackhi_epi16(loA, loB);
+        q[4 * k + 2] = _mm_unpacklo_epi16(hiA, hiB);
+        q[4 * k + 3] = _mm_unpackhi_epi16(hiA, hiB);
+    }
+    for (int k = 0; k != 4; ++k) {
+        _mm_storeu_si128(d + 2 * k, _mm_unpacklo_epi32(q[k], q[4 + k]));
+        _mm_storeu_si128(d + 2 * k + 1, _mm_unpackhi_epi32(q[k], q[4 + k]));
+    }
+}
+
+template <int W>
+TARGET_SSE41 void deshuffleSse41(uint8_t* dst, const uint8_t* src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i p[W];
+        for (int b = 0; b != W; ++b)
+            p[b] = _mm_loadu_si128((const __m128i*)(src + b * count + i));
+        deshuffleStep((__m128i*)(dst + i * W), p, std::integral_constant<int, W>());
+    }
+    for (int b = 0; b != W; ++b) {
+        const uint8_t* plane = src + b * count;
+        for (size_t j = i; j != count; ++j) dst[j * W + W - 1 - b] = plane[j];
+    }
+}
+
+template <int W>
+TARGET_SSE41 inline __m128i add128(__m128i a, __m128i b)
+{
+    return W == 1 ? _mm_add_epi8(a, b) : _mm_add_epi16(a, b);
+}
+
+template <int W>
+TARGET_AVX2 inline __m256i add256(__m256i a, __m256i b)
+{
+    return W == 1 ? _mm256_add_epi8(a, b) : _mm256_add_epi16(a, b);
+}
+
+/*
+    The row is a prefix sum of W byte samples with a stride of S samples.  Within a 16
+    byte block (L = 16 / W samples) it takes log2(L / S) shift and add steps; the running
+    total of the previous block comes in as a carry holding its last pixel broadcast to
+    every lane of the same sample.  Sample j takes sample L - S + j % S of the previous
+    block, which also holds for S = 3 where the sample phase moves by one each block, so
+    every stride uses whole 16 byte blocks.  The first pixel of the row is stored as is,
+    which is what a prefix sum from byte 0 with no carry gives.
+*/
+template <int W, int S, bool Swap>
+TARGET_SSE41 void undoRowSse41(uint8_t* row, size_t n)
+{
+    const int L = 16 / W;
+    alignas(16) int8_t m[16];
+    alignas(16) int8_t sw[16];
+    for (int i = 0; i != 16; ++i) {
+        m[i] = (int8_t)((L - S + (i / W) % S) * W + i % W);
+        sw[i] = (int8_t)(i ^ (W - 1));
+    }
+    const __m128i carryMask = _mm_load_si128((const __m128i*)m);
+    const __m128i swapMask = _mm_load_si128((const __m128i*)sw);
+    __m128i carry = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+        if (Swap) x = _mm_shuffle_epi8(x, swapMask);
+        x = add128<W>(x, _mm_slli_si128(x, S * W));
+        x = add128<W>(x, _mm_slli_si128(x, 2 * S * W));
+        if (4 * S < L) x = add128<W>(x, _mm_slli_si128(x, (4 * S * W) & 15));
+        if (8 * S < L) x = add128<W>(x, _mm_slli_si128(x, (8 * S * W) & 15));
+        x = add128<W>(x, carry);
+        _mm_storeu_si128((__m128i*)(row + i), x);
+        carry = _mm_shuffle_epi8(x, carryMask);
+    }
+    undoRowTail<W, S, Swap>(row, i, n);
+}
+
+/*
+    Same with 32 byte blocks for strides that divide L, where every block has the same
+    sample phase.  Each 128 bit lane is summed on its own, the low lane's last pixel is
+    added to the high lane, and the carry into the next block is the running total of
+    the blocks' last pixels, so the only serial step per block is one add.
+*/
+template <int W, int S, bool Swap>
+TARGET_AVX2 void undoRowAvx2(uint8_t* row, size_t n)
+{
+    const int L = 16 / W;
+    alignas(32) int8_t m[32];
+    alignas(32) int8_t sw[32];
+    for (int i = 0; i != 32; ++i) {
+        m[i] = (int8_t)((L - S + (i % 16 / W) % S) * W + i % W);
+        sw[i] = (int8_t)(i % 16 ^ (W - 1));
+    }
+    const __m256i carryMask = _mm256_load_si256((const __m256i*)m);
+    const __m256i swapMask = _mm256_load_si256((const __m256i*)sw);
+    __m256i carry = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i y = _mm256_loadu_si256((const __m256i*)(row + i));
+        if (Swap) y = _mm256_shuffle_epi8(y, swapMask);
+        y = add256<W>(y, _mm256_slli_si256(y, S * W));
+        y = add256<W>(y, _mm256_slli_si256(y, 2 * S * W));
+        if (4 * S < L) y = add256<W>(y, _mm256_slli_si256(y, (4 * S * W) & 15));
+        if (8 * S < L) y = add256<W>(y, _mm256_slli_si256(y, (8 * S * W) & 15));
+        __m256i low = _mm256_permute2x128_si256(y, y, 0x08);       // 0 : low lane
+        y = add256<W>(y, _mm256_shuffle_epi8(low, carryMask));
+        _mm256_storeu_si256((__m256i*)(row + i), add256<W>(y, carry));
+        __m256i high = _mm256_permute2x128_si256(y, y, 0x11);      // high : high lane
+        carry = add256<W>(carry, _mm256_shuffle_epi8(high, carryMask));
+    }
+    undoRowTail<W, S, Swap>(row, i, n);
+}
+
+bool cpuSupports(PredictorIsa isa)
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7) return isa == PREDICTOR_SCALAR;
+    __cpuid(r, 1);
+    bool sse41 = (r[2] >> 19) & 1;
+    bool osxsave = (r[2] >> 27) & 1;
+    __cpuidex(r, 7, 0);
+    bool avx2 = sse41 && osxsave && ((r[1] >> 5) & 1) && (_xgetbv(0) & 6) == 6;
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (isa == PREDICTOR_AVX2) return avx2;
+    if (isa == PREDICTOR_SSE41) return sse41;
+    return true;
+}
+
+#else
+
+bool cpuSupports(PredictorIsa isa)
+{
+    return isa == PREDICTOR_SCALAR;
+}
+
+#endif // PREDICTOR_X86
+
+// kernels for strides 1-4, index 0 unused; row16 is by byte swap
+struct Kernels
+{
+    PredictorIsa isa;
+    RowKernel row8[5];
+    RowKernel row16[2][5];
+    Deshuffle deshuffle[3];                         // 2, 4 and 8 byte samples
+};
+
+Kernels kernelsFor(PredictorIsa isa)
+{
+    Kernels k = {PREDICTOR_SCALAR,
+                 {nullptr, undoRowScalar<1>, undoRowScalar<2>, undoRowScalar<3>, undoRowScalar<4>},
+                 {{nullptr, undoRow16Scalar<1, false>, undoRow16Scalar<2, false>,
+                   undoRow16Scalar<3, false>, undoRow16Scalar<4, false>},
+                  {nullptr, undoRow16Scalar<1, true>, undoRow16Scalar<2, true>,
+                   undoRow16Scalar<3, true>, undoRow16Scalar<4, true>}},
+                 {deshuffleScalar<2>, deshuffleScalar<4>, deshuffleScalar<8>}};
+#if defined(PREDICTOR_X86)
+    if (isa == PREDICTOR_SSE41 || isa == PREDICTOR_AVX2) {
+        k.isa = PREDICTOR_SSE41;
+        k.row8[1] = undoRowSse41<1, 1, false>;
+        k.row8[2] = undoRowSse41<1, 2, false>;
+        k.row8[3] = undoRowSse41<1, 3, false>;
+        k.row8[4] = undoRowSse41<1, 4, false>;
+        k.row16[0][1] = undoRowSse41<2, 1, false>;
+        k.row16[0][2] = undoRowSse41<2, 2, false>;
+        k.row16[0][3] = undoRowSse41<2, 3, false>;
+        k.row16[0][4] = undoRowSse41<2, 4, false>;
+        k.row16[1][1] = undoRowSse41<2, 1, true>;
+        k.row16[1][2] = undoRowSse41<2, 2, true>;
+        k.row16[1][3] = undoRowSse41<2, 3, true>;
+        k.row16[1][4] = undoRowSse41<2, 4, true>;
+        k.deshuffle[0] = deshuffleSse41<2>;
+        k.deshuffle[1] = deshuffleSse41<4>;
+        k.deshuffle[2] = deshuffleSse41<8>;
+    }
+    if (isa == PREDICTOR_AVX2) {
+        k.isa = PREDICTOR_AVX2;
+        k.row8[1] = undoRowAvx2<1, 1, false>;
+        k.row8[2] = undoRowAvx2<1, 2, false>;
+        k.row8[4] = undoRowAvx2<1, 4, false>;
+        k.row16[0][1] = undoRowAvx2<2, 1, false>;
+        k.row16[0][2] = undoRowAvx2<2, 2, false>;
+        k.row16[0][4] = undoRowAvx2<2, 4, false>;
+        k.row16[1][1] = undoRowAvx2<2, 1, true>;
+        k.row16[1][2] = undoRowAvx2<2, 2, true>;
+        k.row16[1][4] = undoRowAvx2<2, 4, true>;
+    }
+#endif
+    return k;
+}
+
+PredictorIsa bestIsa()
+{
+    if (cpuSupports(PREDICTOR_AVX2)) return PREDICTOR_AVX2;
+    if (cpuSupports(PREDICTOR_SSE41)) return PREDICTOR_SSE41;
+    return PREDICTOR_SCALAR;
+}
+
+// picked once from the CPU on first use
+Kernels &kernels()
+{
+    static Kernels k = kernelsFor(bestIsa());
+    return k;
+}
+
+} // namespace
+
+PredictorIsa predictorIsa()
+{
+    return kernels().isa;
+}
+
+bool setPredictorIsa(PredictorIsa isa)
+{
+    if (!cpuSupports(isa)) return false;
+    kernels() = kernelsFor(isa);
+    return true;
+}
+
+const char* predictorIsaName(PredictorIsa isa)
+{
+    switch (isa) {
+    case PREDICTOR_AVX2: return "avx2";
+    case PREDICTOR_SSE41: return "sse4.1";
+    default: return "scalar";
+    }
+}
+
+void undoHorizontalPredictor8(char* row, size_t bytesPerRow, int stride)
+{
+    if (bytesPerRow <= (size_t)stride) return;
+    if (stride >= 1 && stride <= 4) kernels().row8[stride]((uint8_t*)row, bytesPerRow);
+    else predictRun8(row + stride, row + stride, bytesPerRow - stride, stride);
+}
+
+void undoHorizontalPredictor16(char* row, size_t bytesPerRow, int stride, bool swap)
+{
+    if (stride >= 1 && stride <= 4) {
+        kernels().row16[swap][stride]((uint8_t*)row, bytesPerRow);
+        return;
+    }
+    for (size_t i = 0; i + 2 <= bytesPerRow; i += 2) {
+        uint16_t v;
+        std::memcpy(&v, row + i, 2);
+        if (swap) v = (uint16_t)(v << 8 | v >> 8);
+        if (i >= (size_t)stride * 2) {
+            uint16_t u;
+            std::memcpy(&u, row + i - stride * 2, 2);
+            v = (uint16_t)(v + u);
+        }
+        std::memcpy(row + i, &v, 2);
+    }
+}
+
+void swapBytes16(char* row, size_t bytes)
+{
+    for (size_t i = 0; i + 2 <= bytes; i += 2) std::swap(row[i], row[i + 1]);
+}
+
+void undoFloatingPointPredictor(char* row, size_t bytesPerRow, int stride, int bytesPerSample)
+{
+    // byte planes of the row, kept per thread so rows are undone without allocating
+    static thread_local std::vector<char> planes;
+    const size_t count = bytesPerRow / bytesPerSample;
+    if (!count) return;
+    const size_t bytes = count * bytesPerSample;
+    if (planes.size() < bytes) planes.resize(bytes);
+
+    undoHorizontalPredictor8(row, bytes, stride);
+    std::memcpy(planes.data(), row, bytes);
+    const int k = bytesPerSample == 2 ? 0 : bytesPerSample == 4 ? 1 : 2;
+    kernels().deshuffle[k]((uint8_t*)row, (const uint8_t*)planes.data(), count);
+}
@@ -0,0 +1,92 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+/*
+    Undo TIFF horizontal differencing (Predictor = 2).  Each sample was stored as the
+    difference from the same sample of the pixel before it in the row, so decoding is a
+    running sum along the row with a stride of one pixel.  The first pixel of each row is
+    stored as is.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+    Add the pixel before to k bytes: out[i] = src[i] + out[i - S].  out may be src.  The
+    previous pixel is held in registers instead of being read back from out, which
+    removes the store to load dependency on every byte.  out[-S..-1] must already be
+    decoded, i.e. the k bytes are all past the first pixel of the row.
+*/
+template <int S>
+inline void predictRun8(char* out, const char* src, size_t k)
+{
+    uint8_t prev[S];
+    for (int j = 0; j != S; ++j) prev[j] = (uint8_t)out[j - S];
+    size_t i = 0;
+    for (; i + S <= k; i += S) {
+        for (int j = 0; j != S; ++j) {
+            uint8_t v = (uint8_t)(src[i + j] + prev[j]);
+            out[i + j] = (char)v;
+            prev[j] = v;
+        }
+    }
+    for (int j = 0; i != k; ++i, ++j) out[i] = (char)(src[i] + prev[j]);
+}
+
+// the same for any stride
+inline void predictRun8(char* out, const char* src, size_t k, int stride)
+{
+    switch (stride) {
+    case 1: predictRun8<1>(out, src, k); break;
+    case 2: predictRun8<2>(out, src, k); break;
+    case 3: predictRun8<3>(out, src, k); break;
+    case 4: predictRun8<4>(out, src, k); break;
+    default:
+        for (size_t i = 0; i != k; ++i) out[i] = (char)(src[i] + *(out + i - stride));
+    }
+}
+
+/*
+    Undo the predictor on one whole decoded row of 8 bit samples, in place.  Strides 1-4
+    (gray, gray + alpha, RGB, RGBA) run on SSE4.1 or AVX2 kernels when the CPU has them,
+    picked at run time on first use so one binary runs everywhere.  setPredictorIsa
+    forces a kernel set (for benchmarks), it returns false if the CPU lacks it.
+*/
+enum PredictorIsa
+{
+    PREDICTOR_SCALAR,
+    PREDICTOR_SSE41,
+    PREDICTOR_AVX2
+};
+
+PredictorIsa predictorIsa();
+bool setPredictorIsa(PredictorIsa isa);
+const char* predictorIsaName(PredictorIsa isa);
+
+void undoHorizontalPredictor8(char* row, size_t bytesPerRow, int stride);
+
+/*
+    16 bit samples, stride in samples.  The row is read in the file's byte order and left
+    in the host's: swap is set when the two differ, and the byte swap is folded into the
+    same pass (a shuffle on each block) instead of a second one over the row.
+    swapBytes16 is the conversion alone, for 16 bit rows without a predictor.
+*/
+void undoHorizontalPredictor16(char* row, size_t bytesPerRow, int stride, bool swap);
+void swapBytes16(char* row, size_t bytes);
+
+/*
+    Floating point predictor (Predictor = 3) for 16, 32 and 64 bit samples.  Each row was
+    split into byte planes, most significant byte first, and the planes differenced as
+    bytes with a stride of one pixel.  The byte sums run on the 8 bit kernels (stride is
+    samples per pixel) and the planes are then put back together as host order floats,
+    16 samples at a time on SSE4.1.
+*/
+void undoFloatingPointPredictor(char* row, size_t bytesPerRow, int stride, int bytesPerSample);
+
+inline bool hostBigEndian()
+{
+    const uint16_t one = 1;
+    return *(const uint8_t*)&one == 0;
+}
+
+#endif // PREDICTOR_H
@@ -0,0 +1,98 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int workers)
+{
+    if (workers <= 0) workers = (int)std::thread::hardware_concurrency();
+    if (workers <= 0) workers = 1;
+    for (int i = 0; i != workers; ++i) queues.emplace_back(new Queue);
+    for (int i = 1; i != workers; ++i) threads.emplace_back(&ThreadPool::loop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads) t.join();
+}
+
+void ThreadPool::parallelFor(uint32_t count, const Task &task)
+{
+    if (!count) return;
+    std::lock_guard<std::mutex> serial(forMutex);
+
+    // contiguous blocks so neighbouring strips stay on the same worker
+    const uint64_t n = (uint64_t)size();
+    for (uint64_t w = 0; w != n; ++w) {
+        Queue &q = *queues[w];
+        std::lock_guard<std::mutex> lock(q.m);
+        for (uint32_t i = (uint32_t)(count * w / n); i != (uint32_t)(count * (w + 1) / n); ++i)
+            q.items.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m);
+        job = &task;
+        active = (int)threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    work(0, task);
+
+    std::unique_lock<std::mutex> lock(m);
+    done.wait(lock, [this] { return active == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::loop(int worker)
+{
+    uint64_t seen = 0;
+    for (;;) {
+        const Task* task;
+        {
+            std::unique_lock<std::mutex> lock(m);
+            wake.wait(lock, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+            task = job;
+        }
+
+        work(worker, *task);
+
+        std::lock_guard<std::mutex> lock(m);
+        if (--active == 0) done.notify_one();
+    }
+}
+
+void ThreadPool::work(int worker, const Task &task)
+{
+    uint32_t index;
+    while (pop(worker, index) || steal(worker, index)) task(index, worker);
+}
+
+bool ThreadPool::pop(int worker, uint32_t &index)
+{
+    Queue &q = *queues[worker];
+    std::lock_guard<std::mutex> lock(q.m);
+    if (q.items.empty()) return false;
+    index = q.items.front();
+    q.items.pop_front();
+    return true;
+}
+
+bool ThreadPool::steal(int worker, uint32_t &index)
+{
+    const int n = size();
+    for (int i = 1; i != n; ++i) {
+        Queue &q = *queues[(worker + i) % n];
+        std::lock_guard<std::mutex> lock(q.m);
+        if (q.items.empty()) continue;
+        index = q.items.back();
+        q.items.pop_back();
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/*
+    Fixed pool of worker threads for strip (and tile) level parallelism.  parallelFor
+    hands out indices 0..count-1 and blocks until all have run.  Each worker starts with
+    its own contiguous block of indices in a private queue and pops from the front; a
+    worker that runs dry steals from the back of another worker's queue, so a few large
+    strips do not leave the other cores idle.
+
+    The calling thread works as worker 0, so a pool of size n starts n - 1 threads.  The
+    worker number passed to the task is stable for the duration of the call and can be
+    used to index per-worker state (code tables, scratch buffers).
+*/
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    typedef std::function<void(uint32_t index, int worker)> Task;
+
+    explicit ThreadPool(int workers = 0);       // 0 = std::thread::hardware_concurrency
+    ~ThreadPool();
+
+    int size() const { return (int)queues.size(); }
+    void parallelFor(uint32_t count, const Task &task);
+
+private:
+    struct Queue
+    {
+        std::mutex m;
+        std::deque<uint32_t> items;
+    };
+
+    void loop(int worker);
+    void work(int worker, const Task &task);
+    bool pop(int worker, uint32_t &index);
+    bool steal(int worker, uint32_t &index);
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex forMutex;                        // one parallelFor at a time
+    std::mutex m;                               // guards the fields below
+    std::condition_variable wake;
+    std::condition_variable done;
+    const Task* job = nullptr;
+    uint64_t generation = 0;
+    int active = 0;                             // pool threads still working on job
+    bool quit = false;
+};
+
+#endif // THREADPOOL_H
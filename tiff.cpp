@@ -0,0 +1,262 @@
+#include "tiff.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// byte order helpers
+inline uint16_t get16(const uint8_t* p, bool bigEndian)
+{
+    if (bigEndian) return (uint16_t)(p[0] << 8 | p[1]);
+    return (uint16_t)(p[1] << 8 | p[0]);
+}
+
+inline uint32_t get32(const uint8_t* p, bool bigEndian)
+{
+    if (bigEndian) return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+// random access reads on a std::istream
+struct StreamSource
+{
+    std::istream &f;
+    bool read(uint64_t pos, void* dst, size_t n)
+    {
+        f.clear();
+        f.seekg((std::streamoff)pos);
+        f.read((char*)dst, (std::streamsize)n);
+        return (size_t)f.gcount() == n;
+    }
+};
+
+// reads from a file held in memory (a mapping), checked against its size
+struct MemorySource
+{
+    const char* data;
+    size_t size;
+    bool read(uint64_t pos, void* dst, size_t n)
+    {
+        if (pos > size || n > size - pos) return false;
+        std::memcpy(dst, data + pos, n);
+        return true;
+    }
+};
+
+// first value of an IFD entry, inline or at the offset in the value field
+template <class Source>
+bool entryValue(Source &src, const uint8_t* entry, bool bigEndian, uint32_t &value)
+{
+    uint16_t type = get16(entry + 2, bigEndian);
+    uint32_t count = get32(entry + 4, bigEndian);
+    const uint8_t* v = entry + 8;
+    uint8_t buf[4];
+    if (type == TIFF_SHORT) {
+        if (count > 2) {
+            if (!src.read(get32(v, bigEndian), buf, 2)) return false;
+            v = buf;
+        }
+        value = get16(v, bigEndian);
+        return true;
+    }
+    if (type == TIFF_LONG) {
+        if (count > 1) {
+            if (!src.read(get32(v, bigEndian), buf, 4)) return false;
+            v = buf;
+        }
+        value = get32(v, bigEndian);
+        return true;
+    }
+    return false;
+}
+
+template <class Source>
+bool parse(Source &src, TiffInfo &info)
+{
+    info = TiffInfo();
+
+    // header: byte order, 42, offset to first IFD
+    uint8_t h[8];
+    if (!src.read(0, h, 8)) return false;
+    if (h[0] == 'M' && h[1] == 'M') info.bigEndian = true;
+    else if (h[0] == 'I' && h[1] == 'I') info.bigEndian = false;
+    else return false;
+    const bool be = info.bigEndian;
+    if (get16(h + 2, be) != 42) return false;
+    uint32_t ifdPos = get32(h + 4, be);
+
+    uint8_t nBuf[2];
+    if (!src.read(ifdPos, nBuf, 2)) return false;
+    uint16_t nEntries = get16(nBuf, be);
+
+    // walk the entries one at a time
+    uint8_t e[12];
+    for (uint16_t i = 0; i != nEntries; ++i) {
+        uint32_t entryPos = ifdPos + 2 + i * 12;
+        if (!src.read(entryPos, e, 12)) return false;
+        uint16_t tag = get16(e, be);
+        uint16_t type = get16(e + 2, be);
+        uint32_t count = get32(e + 4, be);
+        uint32_t value = 0;
+
+        switch (tag) {
+        case TIFFTAG_STRIPOFFSETS:
+        case TIFFTAG_STRIPBYTECOUNTS:
+        case TIFFTAG_TILEOFFSETS:
+        case TIFFTAG_TILEBYTECOUNTS: {
+            if (type != TIFF_SHORT && type != TIFF_LONG) return false;
+            // in 64 bits, a crafted count must not wrap to an inline array
+            const uint64_t bytes = (uint64_t)count * ((type == TIFF_SHORT) ? 2 : 4);
+            uint32_t pos = (bytes <= 4) ? entryPos + 8 : get32(e + 8, be);
+            // the file must hold the whole array, so readArray gets no count it cannot read
+            uint8_t last;
+            if (count && !src.read(pos + bytes - 1, &last, 1)) return false;
+            if (tag == TIFFTAG_STRIPOFFSETS || tag == TIFFTAG_TILEOFFSETS) {
+                info.stripOffsetsPos = pos;
+                info.stripOffsetsType = type;
+                info.stripCount = count;
+            }
+            else {
+                info.stripByteCountsPos = pos;
+                info.stripByteCountsType = type;
+                if (count != info.stripCount && info.stripCount) return false;
+                info.stripCount = count;
+            }
+            break;
+        }
+        case TIFFTAG_IMAGEWIDTH:
+        case TIFFTAG_IMAGELENGTH:
+        case TIFFTAG_BITSPERSAMPLE:
+        case TIFFTAG_COMPRESSION:
+        case TIFFTAG_SAMPLESPERPIXEL:
+        case TIFFTAG_ROWSPERSTRIP:
+        case TIFFTAG_PLANARCONFIG:
+        case TIFFTAG_PREDICTOR:
+        case TIFFTAG_TILEWIDTH:
+        case TIFFTAG_TILELENGTH:
+            if (!entryValue(src, e, be, value)) return false;
+            if (tag == TIFFTAG_IMAGEWIDTH) info.width = value;
+            else if (tag == TIFFTAG_IMAGELENGTH) info.height = value;
+            else if (tag == TIFFTAG_BITSPERSAMPLE) info.bitsPerSample = (uint16_t)value;
+            else if (tag == TIFFTAG_COMPRESSION) info.compression = (uint16_t)value;
+            else if (tag == TIFFTAG_SAMPLESPERPIXEL) info.samplesPerPixel = (uint16_t)value;
+            else if (tag == TIFFTAG_ROWSPERSTRIP) info.rowsPerStrip = value;
+            else if (tag == TIFFTAG_PLANARCONFIG) info.planarConfiguration = (uint16_t)value;
+            else if (tag == TIFFTAG_TILEWIDTH) info.tileWidth = value;
+            else if (tag == TIFFTAG_TILELENGTH) info.tileLength = value;
+            else info.predictor = (uint16_t)value;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!info.width || !info.height || !info.stripCount || !info.stripOffsetsPos) return false;
+    if (!info.stripByteCountsPos || !info.samplesPerPixel || !info.bitsPerSample) return false;
+    info.rowsPerStrip = std::min(info.rowsPerStrip, info.height);
+    if (!info.rowsPerStrip) return false;
+    info.tiled = info.tileWidth || info.tileLength;
+    if (info.tiled && (!info.tileWidth || !info.tileLength)) return false;
+    return true;
+}
+
+// read count elements of a SHORT or LONG array straight into dst and widen in place
+template <class Source>
+bool readArray(Source &src, uint32_t pos, uint16_t type, uint32_t count, bool bigEndian,
+               uint32_t* dst)
+{
+    const uint8_t* p = (const uint8_t*)dst;
+    if (type == TIFF_LONG) {
+        if (!src.read(pos, dst, (size_t)count * 4)) return false;
+        for (uint32_t i = 0; i != count; ++i) dst[i] = get32(p + i * 4, bigEndian);
+        return true;
+    }
+    // shorts go in the upper half so widening front to back never overwrites an unread one
+    uint8_t* half = (uint8_t*)dst + (size_t)count * 2;
+    if (!src.read(pos, half, (size_t)count * 2)) return false;
+    for (uint32_t i = 0; i != count; ++i) dst[i] = get16(half + i * 2, bigEndian);
+    return true;
+}
+
+template <class Source>
+bool stripTable(Source &src, const TiffInfo &info, uint32_t* stripOffsets,
+                uint32_t* stripByteCounts)
+{
+    return readArray(src, info.stripOffsetsPos, info.stripOffsetsType, info.stripCount,
+                     info.bigEndian, stripOffsets)
+        && readArray(src, info.stripByteCountsPos, info.stripByteCountsType, info.stripCount,
+                     info.bigEndian, stripByteCounts);
+}
+
+} // namespace
+
+uint32_t TiffInfo::bytesPerRow() const
+{
+    uint32_t samples = (planarConfiguration == PLANARCONFIG_SEPARATE) ? 1 : samplesPerPixel;
+    return (uint32_t)(((uint64_t)width * samples * bitsPerSample + 7) / 8);
+}
+
+size_t TiffInfo::imageBytes() const
+{
+    return (size_t)bytesPerRow() * height * planes();
+}
+
+uint32_t TiffInfo::rowsInStrip(uint32_t strip) const
+{
+    strip %= stripsPerPlane();                               // planes repeat the strips
+    uint32_t row = strip * rowsPerStrip;
+    return std::min(rowsPerStrip, height - row);
+}
+
+uint32_t TiffInfo::planes() const
+{
+    return (planarConfiguration == PLANARCONFIG_SEPARATE) ? samplesPerPixel : 1;
+}
+
+uint32_t TiffInfo::stripsPerPlane() const
+{
+    return (height + rowsPerStrip - 1) / rowsPerStrip;
+}
+
+uint32_t TiffInfo::tileBytesPerRow() const
+{
+    uint32_t samples = (planarConfiguration == PLANARCONFIG_SEPARATE) ? 1 : samplesPerPixel;
+    return (uint32_t)(((uint64_t)tileWidth * samples * bitsPerSample + 7) / 8);
+}
+
+uint32_t TiffInfo::tilesAcross() const
+{
+    return (width + tileWidth - 1) / tileWidth;
+}
+
+uint32_t TiffInfo::tilesPerPlane() const
+{
+    return tilesAcross() * ((height + tileLength - 1) / tileLength);
+}
+
+bool parseTiff(std::istream &f, TiffInfo &info)
+{
+    StreamSource src{f};
+    return parse(src, info);
+}
+
+bool readStripTable(std::istream &f, const TiffInfo &info,
+                    uint32_t *stripOffsets, uint32_t *stripByteCounts)
+{
+    StreamSource src{f};
+    return stripTable(src, info, stripOffsets, stripByteCounts);
+}
+
+bool parseTiff(const char* data, size_t size, TiffInfo &info)
+{
+    MemorySource src{data, size};
+    return parse(src, info);
+}
+
+bool readStripTable(const char* data, size_t size, const TiffInfo &info,
+                    uint32_t *stripOffsets, uint32_t *stripByteCounts)
+{
+    MemorySource src{data, size};
+    return stripTable(src, info, stripOffsets, stripByteCounts);
+}
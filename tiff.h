@@ -0,0 +1,98 @@
+#ifndef TIFF_H
+#define TIFF_H
+
+/*
+    Minimal TIFF 6 IFD reader.  Only the first IFD is walked and only the tags needed to
+    decode LZW strips or tiles are kept.  Both II (little endian) and MM (big endian) files are
+    handled.
+
+    Nothing is allocated.  The header and IFD entries are read in place and the
+    StripOffsets / StripByteCounts arrays are left in the file (only their position is
+    recorded) until readStripTable is called with caller owned storage.  Opening a 2 GB
+    scan touches the pages holding the header and IFD, nothing else.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+
+// tags
+const uint16_t TIFFTAG_IMAGEWIDTH = 256;
+const uint16_t TIFFTAG_IMAGELENGTH = 257;
+const uint16_t TIFFTAG_BITSPERSAMPLE = 258;
+const uint16_t TIFFTAG_COMPRESSION = 259;
+const uint16_t TIFFTAG_PHOTOMETRIC = 262;
+const uint16_t TIFFTAG_STRIPOFFSETS = 273;
+const uint16_t TIFFTAG_SAMPLESPERPIXEL = 277;
+const uint16_t TIFFTAG_ROWSPERSTRIP = 278;
+const uint16_t TIFFTAG_STRIPBYTECOUNTS = 279;
+const uint16_t TIFFTAG_PLANARCONFIG = 284;
+const uint16_t TIFFTAG_PREDICTOR = 317;
+const uint16_t TIFFTAG_TILEWIDTH = 322;
+const uint16_t TIFFTAG_TILELENGTH = 323;
+const uint16_t TIFFTAG_TILEOFFSETS = 324;
+const uint16_t TIFFTAG_TILEBYTECOUNTS = 325;
+const uint16_t TIFFTAG_EXTRASAMPLES = 338;
+
+// field types
+const uint16_t TIFF_SHORT = 3;
+const uint16_t TIFF_LONG = 4;
+
+// tag values
+const uint16_t COMPRESSION_NONE = 1;
+const uint16_t COMPRESSION_LZW = 5;
+const uint16_t PHOTOMETRIC_MINISBLACK = 1;
+const uint16_t PHOTOMETRIC_RGB = 2;
+const uint16_t EXTRASAMPLE_UNSPECIFIED = 0;
+const uint16_t EXTRASAMPLE_UNASSALPHA = 2;
+const uint16_t PREDICTOR_NONE = 1;
+const uint16_t PREDICTOR_HORIZONTAL = 2;
+const uint16_t PREDICTOR_FLOATINGPOINT = 3;
+const uint16_t PLANARCONFIG_CONTIG = 1;
+const uint16_t PLANARCONFIG_SEPARATE = 2;
+
+struct TiffInfo
+{
+    bool bigEndian = false;                     // MM byte order
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint16_t bitsPerSample = 1;                 // first sample (all samples assumed equal)
+    uint16_t samplesPerPixel = 1;
+    uint16_t compression = COMPRESSION_NONE;
+    uint16_t predictor = PREDICTOR_NONE;
+    uint16_t planarConfiguration = PLANARCONFIG_CONTIG;
+    uint32_t rowsPerStrip = 0xFFFFFFFF;         // default is the whole image in one strip
+    bool tiled = false;                         // TileWidth and TileLength present
+    uint32_t tileWidth = 0;
+    uint32_t tileLength = 0;
+
+    // StripOffsets and StripByteCounts arrays, left in the file.  The position is the
+    // file offset of the first element, which is inside the IFD entry itself when the
+    // array fits in 4 bytes.  A tiled image keeps TileOffsets and TileByteCounts here,
+    // stripCount is then the number of tiles (across, then down, then by plane).
+    uint32_t stripCount = 0;
+    uint32_t stripOffsetsPos = 0;
+    uint16_t stripOffsetsType = TIFF_LONG;
+    uint32_t stripByteCountsPos = 0;
+    uint16_t stripByteCountsType = TIFF_LONG;
+
+    uint32_t bytesPerRow() const;               // one row of one strip
+    size_t imageBytes() const;                  // all rows of all planes
+    uint32_t rowsInStrip(uint32_t strip) const; // last strip may be short
+    uint32_t planes() const;                    // samplesPerPixel when planar, else 1
+    uint32_t stripsPerPlane() const;
+    uint32_t tileBytesPerRow() const;           // one row of one tile, padding included
+    uint32_t tilesAcross() const;
+    uint32_t tilesPerPlane() const;
+};
+
+bool parseTiff(std::istream &f, TiffInfo &info);
+bool readStripTable(std::istream &f, const TiffInfo &info,
+                    uint32_t *stripOffsets, uint32_t *stripByteCounts);
+
+// the same on a file held in memory, such as a MappedFile
+bool parseTiff(const char* data, size_t size, TiffInfo &info);
+bool readStripTable(const char* data, size_t size, const TiffInfo &info,
+                    uint32_t *stripOffsets, uint32_t *stripByteCounts);
+
+#endif // TIFF_H
@@ -0,0 +1,302 @@
+#include "tiffwriter.h"
+#include "decoder.h"
+#include "lzwencoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// values in the file's byte order
+void put16(std::vector<char> &f, uint32_t v, bool bigEndian)
+{
+    if (bigEndian) { f.push_back((char)(v >> 8)); f.push_back((char)v); }
+    else { f.push_back((char)v); f.push_back((char)(v >> 8)); }
+}
+
+void put32(std::vector<char> &f, uint32_t v, bool bigEndian)
+{
+    if (bigEndian) { put16(f, v >> 16, true); put16(f, v & 0xFFFF, true); }
+    else { put16(f, v & 0xFFFF, false); put16(f, v >> 16, false); }
+}
+
+void put(std::vector<char> &f, uint32_t v, uint16_t type, bool bigEndian)
+{
+    if (type == TIFF_SHORT) put16(f, v, bigEndian);
+    else put32(f, v, bigEndian);
+}
+
+struct Field
+{
+    uint16_t tag;
+    uint16_t type;
+    std::vector<uint32_t> values;
+};
+
+// the IFD at file offset ifd, the arrays that do not fit in an entry right after it
+std::vector<char> ifdBytes(const TiffInfo &info, uint32_t ifd,
+                           const std::vector<uint32_t> &offsets,
+                           const std::vector<uint32_t> &counts)
+{
+    const bool be = info.bigEndian;
+    const uint32_t spp = info.samplesPerPixel;
+    const uint32_t colours = spp >= 3 ? 3 : 1;
+    std::vector<Field> fields = {
+        {TIFFTAG_IMAGEWIDTH, TIFF_LONG, {info.width}},
+        {TIFFTAG_IMAGELENGTH, TIFF_LONG, {info.height}},
+        {TIFFTAG_BITSPERSAMPLE, TIFF_SHORT, std::vector<uint32_t>(spp, info.bitsPerSample)},
+        {TIFFTAG_COMPRESSION, TIFF_SHORT, {COMPRESSION_LZW}},
+        {TIFFTAG_PHOTOMETRIC, TIFF_SHORT,
+         {colours == 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK}},
+        {TIFFTAG_STRIPOFFSETS, TIFF_LONG, offsets},
+        {TIFFTAG_SAMPLESPERPIXEL, TIFF_SHORT, {spp}},
+        {TIFFTAG_ROWSPERSTRIP, TIFF_LONG, {info.rowsPerStrip}},
+        {TIFFTAG_STRIPBYTECOUNTS, TIFF_LONG, counts},
+        {TIFFTAG_PLANARCONFIG, TIFF_SHORT, {info.planarConfiguration}},
+        {TIFFTAG_PREDICTOR, TIFF_SHORT, {info.predictor}},
+    };
+    if (spp > colours) {                        // alpha, then any others unspecified
+        std::vector<uint32_t> extra(spp - colours, EXTRASAMPLE_UNSPECIFIED);
+        extra[0] = EXTRASAMPLE_UNASSALPHA;
+        fields.push_back({TIFFTAG_EXTRASAMPLES, TIFF_SHORT, extra});
+    }
+
+    std::vector<char> f;
+    std::vector<char> extra;
+    const uint32_t extraPos = ifd + 2 + 12 * (uint32_t)fields.size() + 4;
+    put16(f, (uint32_t)fields.size(), be);
+    for (const Field &field : fields) {
+        const uint32_t size = field.type == TIFF_SHORT ? 2 : 4;
+        const uint32_t count = (uint32_t)field.values.size();
+        put16(f, field.tag, be);
+        put16(f, field.type, be);
+        put32(f, count, be);
+        if (count * size <= 4) {
+            for (uint32_t v : field.values) put(f, v, field.type, be);
+            for (uint32_t i = count * size; i != 4; ++i) f.push_back(0);
+        }
+        else {
+            put32(f, extraPos + (uint32_t)extra.size(), be);
+            for (uint32_t v : field.values) put(extra, v, field.type, be);
+        }
+    }
+    put32(f, 0, be);                            // no next IFD
+    f.insert(f.end(), extra.begin(), extra.end());
+    return f;
+}
+
+// compressed, the middle of 64 - 256 KB, and the smallest strip cut to feed the workers
+const double stripTargetBytes = 128 * 1024;
+const double stripMinBytes = 16 * 1024;
+
+// compressed bytes per row, from up to 8 bands of 8 rows spread over the first plane
+double compressedRowBytes(const TiffInfo &info, const char* image)
+{
+    const uint32_t bandRows = std::min(8u, info.height);
+    const uint32_t bands = std::min(8u, info.height / bandRows);
+    const size_t bytes = (size_t)bandRows * info.bytesPerRow();
+    const LzwParams p = lzwParams(info);
+    std::vector<char> out(lzwCompressBound(bytes));
+    size_t total = 0;
+    for (uint32_t b = 0; b != bands; ++b) {
+        const uint32_t row = (uint32_t)((uint64_t)(info.height - bandRows) * b /
+                                        std::max(bands - 1, 1u));
+        total += compressLZW(image + (size_t)row * info.bytesPerRow(), bytes, out.data(),
+                             out.size(), p);
+    }
+    return std::max((double)total / (bands * bandRows), 1.0);
+}
+
+// info as it will be written, false when the writer cannot do it
+bool fileInfo(const TiffInfo &info, const char* image, int workers, TiffInfo &file)
+{
+    file = info;
+    file.compression = COMPRESSION_LZW;
+    file.rowsPerStrip = std::min(info.rowsPerStrip, info.height);
+    if (info.tiled || !info.width || !info.height) return false;
+    if (!info.samplesPerPixel || !info.bitsPerSample) return false;
+    if (info.predictor == PREDICTOR_HORIZONTAL) {
+        if (info.bitsPerSample != 8 && info.bitsPerSample != 16) return false;
+    }
+    else if (info.predictor != PREDICTOR_NONE) return false;
+    if (!file.rowsPerStrip) file.rowsPerStrip = chooseRowsPerStrip(file, image, workers);
+    return true;
+}
+
+// the strip's rows in image
+const char* stripStart(const TiffInfo &info, const char* image, uint32_t strip)
+{
+    const uint32_t plane = strip / info.stripsPerPlane();
+    const uint32_t row = strip % info.stripsPerPlane() * info.rowsPerStrip;
+    return image + ((size_t)plane * info.height + row) * info.bytesPerRow();
+}
+
+size_t stripBytes(const TiffInfo &info, uint32_t strip)
+{
+    return (size_t)info.rowsInStrip(strip) * info.bytesPerRow();
+}
+
+// appends to f and keeps the position in the tiff, which must stay a 32 bit offset;
+// the tiff starts where f was, not necessarily at 0
+struct Output
+{
+    std::ostream &f;
+    std::streampos start;
+    uint64_t pos = 0;
+    bool ok = true;
+
+    explicit Output(std::ostream &f) : f(f), start(f.tellp()) { ok = start != std::streampos(-1); }
+
+    void write(const char* data, size_t n)
+    {
+        if (!ok) return;
+        f.write(data, (std::streamsize)n);
+        pos += n;
+        ok = f && pos <= 0xFFFFFFFF;
+    }
+};
+
+void writeHeader(Output &out, bool bigEndian)
+{
+    std::vector<char> h;
+    h.push_back(bigEndian ? 'M' : 'I');
+    h.push_back(bigEndian ? 'M' : 'I');
+    put16(h, 42, bigEndian);
+    put32(h, 0, bigEndian);                     // IFD offset, set by writeIfd
+    out.write(h.data(), h.size());
+}
+
+bool writeIfd(Output &out, const TiffInfo &info, const std::vector<uint32_t> &offsets,
+              const std::vector<uint32_t> &counts)
+{
+    const char pad = 0;
+    if (out.pos % 2) out.write(&pad, 1);        // word aligned
+    const uint32_t ifd = (uint32_t)out.pos;
+    const std::vector<char> bytes = ifdBytes(info, ifd, offsets, counts);
+    out.write(bytes.data(), bytes.size());
+    if (!out.ok) return false;
+
+    std::vector<char> offset;
+    put32(offset, ifd, info.bigEndian);
+    out.f.seekp(out.start + (std::streamoff)4);
+    out.f.write(offset.data(), 4);
+    out.f.seekp(0, std::ios::end);
+    return (bool)out.f;
+}
+
+} // namespace
+
+uint32_t chooseRowsPerStrip(const TiffInfo &info, const char* image, int workers)
+{
+    const double rowBytes = compressedRowBytes(info, image);
+    const uint32_t maxRows = info.height;
+    uint32_t rows = (uint32_t)std::min(std::max(stripTargetBytes / rowBytes, 1.0),
+                                       (double)maxRows);
+
+    // too few strips to go round: cut them down to 4 per worker, but not below the minimum
+    const uint32_t planes = info.planes();
+    const uint32_t strips = 4 * (uint32_t)std::max(workers, 1);
+    if ((uint64_t)planes * ((info.height + rows - 1) / rows) < strips) {
+        const uint32_t perPlane = (strips + planes - 1) / planes;
+        const uint32_t parallelRows = std::max((info.height + perPlane - 1) / perPlane, 1u);
+        const uint32_t minRows = (uint32_t)std::min(std::ceil(stripMinBytes / rowBytes),
+                                                    (double)maxRows);
+        rows = std::min(rows, std::max(parallelRows, minRows));
+    }
+    return rows;
+}
+
+bool writeTiff(std::ostream &f, const TiffInfo &info, const char* image)
+{
+    TiffInfo file;
+    if (!fileInfo(info, image, (int)std::thread::hardware_concurrency(), file)) return false;
+    const uint32_t count = file.planes() * file.stripsPerPlane();
+    const LzwParams p = lzwParams(file);
+
+    Output out(f);
+    writeHeader(out, file.bigEndian);
+    std::vector<uint32_t> offsets(count), counts(count);
+    std::vector<char> strip(lzwCompressBound(stripBytes(file, 0)));
+    for (uint32_t s = 0; s != count && out.ok; ++s) {
+        const size_t n = compressLZW(stripStart(file, image, s), stripBytes(file, s),
+                                     strip.data(), strip.size(), p);
+        if (!n) return false;
+        offsets[s] = (uint32_t)out.pos;
+        counts[s] = (uint32_t)n;
+        out.write(strip.data(), n);
+    }
+    return out.ok && writeIfd(out, file, offsets, counts);
+}
+
+bool writeTiffParallel(std::ostream &f, const TiffInfo &info, const char* image,
+                       ThreadPool &pool)
+{
+    TiffInfo file;
+    if (!fileInfo(info, image, pool.size(), file)) return false;
+    const uint32_t count = file.planes() * file.stripsPerPlane();
+    const LzwParams p = lzwParams(file);
+
+    // compressed strips waiting for the I/O thread
+    struct Pending
+    {
+        std::vector<char> bytes;
+        bool ready = false;
+        bool ok = false;
+    };
+    std::vector<Pending> pending(count);
+    std::mutex m;
+    std::condition_variable changed;            // a strip is ready or one was written
+    uint32_t written = 0;
+
+    Output out(f);
+    writeHeader(out, file.bigEndian);
+    std::vector<uint32_t> offsets(count), counts(count);
+    bool coded = true;
+    std::thread io([&] {
+        for (uint32_t s = 0; s != count; ++s) {
+            std::vector<char> bytes;
+            std::unique_lock<std::mutex> lock(m);
+            changed.wait(lock, [&] { return pending[s].ready; });
+            bytes.swap(pending[s].bytes);
+            coded &= pending[s].ok;
+            lock.unlock();
+
+            offsets[s] = (uint32_t)out.pos;
+            counts[s] = (uint32_t)bytes.size();
+            out.write(bytes.data(), bytes.size());
+
+            lock.lock();
+            written = s + 1;
+            changed.notify_all();
+        }
+    });
+
+    std::vector<std::vector<char>> scratch(pool.size());
+    const uint32_t batch = 4 * (uint32_t)pool.size();
+    for (uint32_t first = 0; first < count; first += batch) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            changed.wait(lock, [&] { return first < batch || written >= first - batch; });
+        }
+        pool.parallelFor(std::min(batch, count - first), [&](uint32_t i, int worker) {
+            const uint32_t s = first + i;
+            const size_t bytes = stripBytes(file, s);
+            std::vector<char> &buffer = scratch[worker];
+            if (buffer.size() < lzwCompressBound(bytes)) buffer.resize(lzwCompressBound(bytes));
+            const size_t n = compressLZW(stripStart(file, image, s), bytes, buffer.data(),
+                                         buffer.size(), p);
+            std::vector<char> strip(buffer.begin(), buffer.begin() + n);
+            std::lock_guard<std::mutex> lock(m);
+            pending[s].bytes.swap(strip);
+            pending[s].ready = true;
+            pending[s].ok = n != 0;
+            changed.notify_all();
+        });
+    }
+    io.join();
+    return coded && out.ok && writeIfd(out, file, offsets, counts);
+}
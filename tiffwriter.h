@@ -0,0 +1,49 @@
+#ifndef TIFFWRITER_H
+#define TIFFWRITER_H
+
+/*
+    LZW tiff writer, the reverse of decodeImage.  image is laid out the way decodeImage
+    writes it: rows of info.bytesPerRow(), plane after plane for a planar image, 16 bit
+    samples in host byte order.  info gives the geometry and the file's choices: width,
+    height, bitsPerSample, samplesPerPixel, planarConfiguration, rowsPerStrip, predictor
+    (none or horizontal) and the byte order.  Compression is always LZW.  Tiled output and
+    the floating point predictor are not written.
+
+    The file is the 8 byte header, the strips in order and then the IFD, word aligned,
+    with the arrays that do not fit in an entry after it.  The IFD offset in the header is
+    filled in last, so f must be seekable (a file or a stringstream); the tiff starts
+    at f's position, offsets count from there.  Classic tiff offsets are 32 bit: a file
+    that would pass 4 GB fails.  Samples past the colours (RGB or grey) are tagged as
+    ExtraSamples, the first one unassociated alpha.
+
+    writeTiffParallel compresses strips on a ThreadPool while one I/O thread writes them
+    out in order as each becomes the next one due, so the writes overlap the coding.
+    Strips go to the pool in batches of four per worker and a batch is only started once
+    the one two before it is on disk, which holds at most two batches of compressed
+    strips in memory whatever the image size.
+
+    RowsPerStrip decides how parallel a later decode can be: strips are the decoder's
+    tasks.  With info.rowsPerStrip 0 the writers pick it with chooseRowsPerStrip, for
+    the pool's workers or, for writeTiff, the cores of this machine.  It aims at
+    about 128 KB of compressed data per strip, inside the 64 - 256 KB where a strip is
+    big enough to code well and small enough to spread.  When that gives fewer than 4
+    strips per worker the strips are cut to 4 per worker, but not below 16 KB.  The
+    compressed size of a row is estimated by coding 8 bands of 8 rows spread over the
+    image.
+
+    Both return false when a write fails, the image cannot be coded (see compressLZW) or
+    the file would be too big; what was written to f is then incomplete.
+*/
+
+#include "threadpool.h"
+#include "tiff.h"
+
+#include <ostream>
+
+uint32_t chooseRowsPerStrip(const TiffInfo &info, const char* image, int workers);
+
+bool writeTiff(std::ostream &f, const TiffInfo &info, const char* image);
+bool writeTiffParallel(std::ostream &f, const TiffInfo &info, const char* image,
+                       ThreadPool &pool);
+
+#endif // TIFFWRITER_H